@@ -0,0 +1,52 @@
+#pragma once
+
+#include "util.h"
+
+#define NULL_NODE -1
+
+// Leaf bounds are enlarged by this much so small movements do not require reinsertion
+#define TREE_MARGIN 0.1f
+
+
+typedef struct {
+    Vector3 min;
+    Vector3 max;
+    int parent;  // Next free node while on the free list
+    int left;    // NULL_NODE for leaves
+    int right;
+    int height;  // 0 for leaves, -1 for free nodes
+    Entity entity;
+} TreeNode;
+
+
+typedef bool (*TreeQueryCallback)(void* data, Entity entity);
+typedef float (*TreeRaycastCallback)(void* data, Entity entity, float max_distance);
+
+
+// Dynamic bounding volume hierarchy with enlarged leaf bounds. Leaves are inserted next to the
+// sibling that increases total surface area least and the tree is kept balanced with rotations.
+typedef struct {
+    TreeNode* nodes;
+    int capacity;
+    int root;
+    int free_list;
+    int leaves;
+} AABBTree;
+
+
+AABBTree* AABBTree_create();
+
+int AABBTree_insert(AABBTree* tree, Entity entity, Vector3 min, Vector3 max);
+
+void AABBTree_remove(AABBTree* tree, int leaf);
+
+bool AABBTree_move(AABBTree* tree, int leaf, Vector3 min, Vector3 max);
+
+void AABBTree_query(AABBTree* tree, Vector3 min, Vector3 max, TreeQueryCallback callback, void* data);
+
+void AABBTree_raycast(AABBTree* tree, Vector3 origin, Vector3 direction, float max_distance,
+    TreeRaycastCallback callback, void* data);
+
+void AABBTree_clear(AABBTree* tree);
+
+void AABBTree_destroy(AABBTree* tree);
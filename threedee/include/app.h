@@ -5,6 +5,7 @@
 #include <SDL3/SDL.h>
 
 #include "interface.h"
+#include "scheduler.h"
 
 #define CONTROLLER_NONE -2
 #define CONTROLLER_MKB -1
@@ -42,6 +43,7 @@ typedef struct {
     const char* base_path;
     SDL_GPUDevice* gpu_device;
     int debug_level;
+    Scheduler* scheduler;
 } App;
 
 
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "util.h"
+#include "componentarray.h"
+#include "components/collider.h"
+#include "aabbtree.h"
+
+// Bounds are padded since the narrowphase reports contacts slightly before shapes touch.
+// The cuboid test pads its axes relative to the size of the boxes.
+#define BROADPHASE_MARGIN 0.01f
+#define BROADPHASE_RELATIVE_MARGIN 1.0e-3f
+
+#define GRID_CELL_SIZE 2.0f
+// Colliders covering more cells than this are tested against everything instead
+#define GRID_MAX_CELLS 64
+
+
+typedef enum {
+    BROADPHASE_SAP,
+    BROADPHASE_TREE,
+    BROADPHASE_GRID
+} BroadphaseType;
+
+
+typedef struct {
+    Entity entity;
+    float value;
+    bool max;
+} Endpoint;
+
+
+typedef struct {
+    Entity entity;
+    Vector3 min;
+    Vector3 max;
+    ColliderGroup group;
+    BodyType body;
+    int node;  // Leaf in the tree of its partition
+} Proxy;
+
+
+typedef struct {
+    int x;
+    int y;
+    int z;
+    int proxy;
+} GridCell;
+
+
+typedef struct {
+    Entity entity;
+    Entity other;
+} CollisionPair;
+
+
+// Colliders are split into moving and static partitions, each with its own tree that is also used
+// for ray queries. Static colliders are only updated when their transform or collider changes, and
+// static pairs are never tested. Pairs among moving colliders are found either by querying the
+// tree, by sweep and prune along the axis where the colliders are most spread out, or by hashing
+// the colliders into a uniform grid. Dynamic colliders then query the static tree. Endpoints stay sorted between
+// updates, so re-sorting after small movements is close to linear. The grid suits many colliders
+// of similar size, with the cell size a bit larger than a typical collider.
+typedef struct {
+    BroadphaseType type;
+    ComponentArray* proxies;
+    AABBTree* tree;
+    ComponentArray* static_proxies;
+    AABBTree* static_tree;
+    Endpoint* endpoints;
+    int endpoints_size;
+    int endpoints_capacity;
+    int axis;
+    Proxy** active;
+    int active_capacity;
+    float cell_size;
+    GridCell* cells;
+    GridCell* sorted_cells;
+    int cells_size;
+    int cells_capacity;
+    int* buckets;
+    int buckets_capacity;
+    CollisionPair* pairs;  // Candidate pairs found by the last update
+    int pairs_size;
+    int pairs_capacity;
+} Broadphase;
+
+
+Broadphase* Broadphase_create(BroadphaseType type);
+
+void Broadphase_update(Broadphase* broadphase, ComponentArray* colliders);
+
+void Broadphase_destroy(Broadphase* broadphase);
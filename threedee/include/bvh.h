@@ -0,0 +1,43 @@
+#pragma once
+
+#include "util.h"
+
+// Leaves are not split further once they hold this many triangles
+#define BVH_LEAF_SIZE 4
+
+
+typedef struct {
+    Vector3 min;
+    Vector3 max;
+    int first;  // First triangle of a leaf, or the right child of an inner node whose left child follows it
+    int count;  // Triangles in a leaf, 0 for inner nodes
+} BVHNode;
+
+
+typedef bool (*BVHQueryCallback)(void* data, int triangle);
+
+
+// Static bounding volume hierarchy over the triangles of a mesh, built once when the mesh is
+// loaded. Triangles are split at the median of their centroids along the longest axis, and the
+// nodes are stored depth first in one array so that a query walks memory mostly forwards.
+typedef struct {
+    Vector3* vertices;
+    int vertices_size;
+    int* indices;  // Three vertices per triangle, ordered so that the triangles of a leaf are adjacent
+    int triangles_size;
+    BVHNode* nodes;
+    int nodes_size;
+} BVH;
+
+
+BVH* BVH_create(Vector3* vertices, int vertices_size, int* indices, int indices_size);
+
+Triangle BVH_triangle(BVH* bvh, int triangle);
+
+void BVH_bounds(BVH* bvh, Vector3* min, Vector3* max);
+
+void BVH_query(BVH* bvh, Vector3 min, Vector3 max, BVHQueryCallback callback, void* data);
+
+float BVH_raycast(BVH* bvh, Vector3 origin, Vector3 direction, float max_distance, Vector3* normal);
+
+void BVH_destroy(BVH* bvh);
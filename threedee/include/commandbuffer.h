@@ -0,0 +1,56 @@
+#pragma once
+
+#include "component.h"
+
+
+// Sets up a component on a created entity from a copy of the recorded parameters
+typedef void (*ComponentConstructor)(Entity entity, void* parameters);
+
+
+typedef enum {
+    COMMAND_CREATE,
+    COMMAND_DESTROY,
+    COMMAND_ADD_COMPONENT,
+    COMMAND_REMOVE_COMPONENT
+} CommandType;
+
+
+typedef struct {
+    CommandType type;
+    Entity entity;
+    ComponentType component_type;
+    ComponentConstructor constructor;
+    int parameters;  // Offset of the parameters in the buffer data, -1 if none
+} Command;
+
+
+// Records structural changes so they can be made while iterating over components and applied
+// together at a sync point. Entities created through the buffer get placeholder handles that
+// are only valid for other commands in the same buffer until it is executed.
+typedef struct {
+    Command* commands;
+    int size;
+    int capacity;
+    char* data;
+    int data_size;
+    int data_capacity;
+    int created;  // Placeholder handles handed out since the last execute
+} CommandBuffer;
+
+
+CommandBuffer* CommandBuffer_create();
+
+Entity CommandBuffer_create_entity(CommandBuffer* buffer);
+
+void CommandBuffer_destroy_entity(CommandBuffer* buffer, Entity entity);
+
+void CommandBuffer_add_component(CommandBuffer* buffer, Entity entity, ComponentType component_type,
+    ComponentConstructor constructor, void* parameters, int parameters_size);
+
+void CommandBuffer_remove_component(CommandBuffer* buffer, Entity entity, ComponentType component_type);
+
+void CommandBuffer_execute(CommandBuffer* buffer);
+
+void CommandBuffer_clear(CommandBuffer* buffer);
+
+void CommandBuffer_destroy(CommandBuffer* buffer);
@@ -5,6 +5,7 @@
 #include "util.h"
 #include "list.h"
 #include "linalg.h"
+#include "componentarray.h"
 #include "components/camera.h"
 #include "components/collider.h"
 #include "components/controller.h"
@@ -15,7 +16,11 @@
 #include "components/transform.h"
 #include "components/weather.h"
 
-#define MAX_ENTITIES 2000
+#define MAX_ENTITIES (1 << ENTITY_INDEX_BITS)
+#define ENTITY_ALIVE -2
+#define MAX_QUERIES 32
+
+#define COMPONENT_MASK(type) (1u << (type))
 
 
 typedef struct {
@@ -33,21 +38,6 @@ typedef struct {
     Filename loop_sound;
 } SoundComponent;
 
-typedef struct ComponentData {
-    int entities;
-    List* added_entities;
-    TransformComponent* transform[MAX_ENTITIES];
-    CameraComponent* camera[MAX_ENTITIES];
-    SoundComponent* sound[MAX_ENTITIES];
-    MeshComponent* mesh[MAX_ENTITIES];
-    LightComponent* light[MAX_ENTITIES];
-    RigidBodyComponent* rigid_body[MAX_ENTITIES];
-    ColliderComponent* collider[MAX_ENTITIES];
-    ControllerComponent* controller[MAX_ENTITIES];
-    WeatherComponent* weather[MAX_ENTITIES];
-    PlayerComponent* player[MAX_ENTITIES];
-} ComponentData;
-
 typedef enum ComponentType {
     COMPONENT_TRANSFORM,
     COMPONENT_CAMERA,
@@ -59,19 +49,84 @@ typedef enum ComponentType {
     COMPONENT_CONTROLLER,
     COMPONENT_WEATHER,
     COMPONENT_PLAYER,
+    COMPONENT_COUNT
 } ComponentType;
 
+typedef struct {
+    int generation;
+    int next_free;  // Next slot in the free list, ENTITY_ALIVE if the slot is in use
+    unsigned int mask;  // Bit per component type the entity has
+} EntitySlot;
+
+typedef struct {
+    unsigned int mask;
+    ComponentArray* matches;  // Entities having every component in the mask
+} Query;
+
+// Transforms flattened in breadth-first order, so every parent comes before its children and
+// each depth level is a contiguous range that can be updated independently.
+typedef struct {
+    int* order;          // Dense transform slots sorted by depth
+    int* parents;        // Dense transform slot of each entry's parent, -1 for roots
+    int* level_offsets;  // Start of each depth level in order, followed by the total size
+    int levels;
+    int size;
+    int capacity;
+    bool dirty;          // Set when transforms are added, removed or reparented
+} Hierarchy;
+
+// Component changes since the start of the frame, as entity sets. A component added and removed
+// within the same frame appears in neither added nor removed.
+typedef struct {
+    ComponentArray* added;
+    ComponentArray* removed;   // Handles may no longer exist
+    ComponentArray* modified;  // Marked with mark_modified, transforms by their setters
+} ComponentChanges;
+
+typedef struct ComponentData {
+    int entities;
+    int alive_entities;
+    EntitySlot* slots;
+    int slots_capacity;
+    int free_slot;
+    Query queries[MAX_QUERIES];
+    int queries_size;
+    Hierarchy hierarchy;
+    ComponentChanges changes[COMPONENT_COUNT];
+    ComponentArray* transform;
+    ComponentArray* camera;
+    ComponentArray* sound;
+    ComponentArray* mesh;
+    ComponentArray* light;
+    ComponentArray* rigid_body;
+    ComponentArray* collider;
+    ComponentArray* controller;
+    ComponentArray* weather;
+    ComponentArray* player;
+} ComponentData;
+
 ComponentData* ComponentData_create();
 
 SoundComponent* SoundComponent_add(Entity entity, Filename hit_sound);
 SoundComponent* SoundComponent_get(Entity entity);
 void SoundComponent_remove(Entity entity);
 
+ComponentArray* get_component_array(ComponentType component_type);
+
 void* add_component(Entity entity, ComponentType component_type);
 void* get_component(Entity entity, ComponentType component_type);
 void remove_component(Entity entity, ComponentType component_type);
+void release_component(Entity entity, ComponentType component_type);
+bool has_components(Entity entity, unsigned int mask);
+ComponentArray* query_entities(unsigned int mask);
+void reserve_components(ComponentType component_type, int count);
+void mark_modified(Entity entity, ComponentType component_type);
+ComponentChanges* get_changes(ComponentType component_type);
+void clear_changes();
+void print_component_stats();
 
 Entity create_entity();
+void reserve_entities(int count);
 void destroy_entity(Entity i);
 void destroy_entities(List* entities);
 void destroy_entity_recursive(Entity entity);
@@ -85,6 +140,12 @@ void ComponentData_clear();
 
 Matrix4 get_transform(Entity entity);
 void set_transform(Entity entity, Matrix4 transform);
+void mark_transform_dirty(Entity entity);
+void update_transforms();
+void update_transform_range(int start, int end);
+void set_position(Entity entity, Vector3 position);
+void set_rotation(Entity entity, Quaternion rotation);
+void set_scale(Entity entity, Vector3 scale);
 Vector3 get_position(Entity entity);
 Vector2 get_xy(Entity entity);
 Quaternion get_rotation(Entity entity);
@@ -97,7 +158,7 @@ Vector2 get_scale_interpolated(int entity, float delta);
 bool entity_exists(Entity entity);
 
 int get_parent(Entity entity);
-List* get_children(Entity entity);
+Entity next_in_subtree(Entity entity, Entity root, bool descend);
 
 Vector3 get_entities_center(List* entities);
 
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "util.h"
+#include "pool.h"
+
+#define COMPONENT_PAGE_BITS 10
+#define COMPONENT_PAGE_SIZE (1 << COMPONENT_PAGE_BITS)
+
+
+// With an element size of 0 the array is a plain set of entities.
+typedef struct ComponentArray {
+    void* data;         // Densely packed components
+    Entity* entities;   // Owner entity of each dense slot
+    int** pages;        // Dense slot of each entity index, -1 if the entity has no component
+    int pages_size;
+    int size;
+    int capacity;
+    int element_size;
+    int peak;           // Largest size reached
+    int grows;          // Times the dense storage was reallocated
+} ComponentArray;
+
+
+ComponentArray* ComponentArray_create(int element_size);
+
+void ComponentArray_reserve(ComponentArray* array, int capacity);
+
+void* ComponentArray_add(ComponentArray* array, Entity entity);
+
+void* ComponentArray_get(ComponentArray* array, Entity entity);
+
+void* ComponentArray_at(ComponentArray* array, int index);
+
+int ComponentArray_index(ComponentArray* array, Entity entity);
+
+bool ComponentArray_has(ComponentArray* array, Entity entity);
+
+void ComponentArray_remove(ComponentArray* array, Entity entity);
+
+void ComponentArray_clear(ComponentArray* array);
+
+void ComponentArray_destroy(ComponentArray* array);
+
+Pool* ComponentArray_page_pool();
@@ -3,6 +3,11 @@
 
 #include <arraylist.h>
 #include <util.h>
+#include <componentarray.h>
+#include <heightfield.h>
+
+// Half extent used for the bounds of infinite planes
+#define PLANE_BOUNDS 1.0e6f
 
 
 typedef enum {
@@ -10,7 +15,9 @@ typedef enum {
     COLLIDER_SPHERE,
     COLLIDER_CUBOID,
     COLLIDER_CAPSULE,
-    COLLIDER_AABB
+    COLLIDER_AABB,
+    COLLIDER_MESH,  // Static triangle mesh, tested against spheres, capsules and boxes
+    COLLIDER_HEIGHTFIELD  // Static terrain sampled on a grid, tested like a mesh
 } ColliderType;
 
 
@@ -22,11 +29,22 @@ typedef enum {
 } ColliderGroup;
 
 
+// Static colliders have no rigid body and only move when something sets their transform.
+// Kinematic bodies have zero inverse mass and are moved by code, but push dynamic bodies.
+typedef enum {
+    BODY_STATIC,
+    BODY_KINEMATIC,
+    BODY_DYNAMIC
+} BodyType;
+
+
+// A contact point of a pair as seen from one of its colliders
 typedef struct {
     Entity entity;
     Vector3 overlap;
     Vector3 offset;
     Vector3 offset_other;
+    int contact;  // Index in the contact cache, shared by both colliders
 } Collision;
 
 
@@ -37,7 +55,15 @@ typedef struct {
     float width;
     float height;
     float depth;
-    ArrayList* collisions;
+    int mesh_index;  // Mesh of mesh colliders, -1 for other types
+    Heightfield* heightfield;  // Heights of heightfield colliders, NULL for other types
+    bool sensor;  // Only reports overlaps as contact events, without contact points or impulses
+    int events_start;  // Contact events of this collider in the last update, see ContactCache
+    int events_size;
+    Shape shape;  // World space shape and bounds, cached once per tick by update_collider_shapes
+    AABB bounds;
+    bool static_shape;  // Kept while shape_dirty is not set
+    bool shape_dirty;  // Transform or collider changed, cleared once the shape and broadphase proxy are refreshed
 } ColliderComponent;
 
 
@@ -48,6 +74,11 @@ typedef struct {
     float width;
     float height;
     float depth;
+    char* mesh;  // Name of the mesh of mesh colliders
+    int samples;  // Samples along each side of heightfield colliders, generated from Perlin noise
+    int octaves;
+    float persistence;
+    bool sensor;
 } ColliderParameters;
 
 
@@ -57,6 +88,14 @@ Vector3 get_half_extents(Entity entity);
 
 Shape get_shape(Entity entity);
 
+AABB get_bounds(Entity entity);
+
+BodyType get_body_type(Entity entity);
+
+void update_collider_shapes(ComponentArray* colliders);
+
+bool groups_collide(ColliderGroup group, ColliderGroup other_group);
+
 void ColliderComponent_add(Entity entity, ColliderParameters parameters);
 
 void ColliderComponent_remove(Entity entity);
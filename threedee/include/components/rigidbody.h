@@ -29,6 +29,7 @@ typedef struct {
     float angular_damping;
     float max_speed;
     float max_angular_speed;
+    bool fast;  // Swept against static colliders each step so that it cannot pass through them
     AxisLock axis_lock;
 } RigidBodyComponent;
 
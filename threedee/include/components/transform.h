@@ -2,15 +2,20 @@
 
 #include "linalg.h"
 #include "util.h"
-#include "list.h"
 
 
+// Position, rotation and scale are local to the parent. Change them with set_position, set_rotation
+// and set_scale so that the cached world matrix is rebuilt.
 typedef struct {
     Vector3 position;
     Quaternion rotation;
     Vector3 scale;
+    Matrix4 world;
+    bool dirty;
     Entity parent;
-    List* children;
+    Entity first_child;
+    Entity next_sibling;
+    Entity prev_sibling;
     float lifetime;
     Filename prefab;
     struct {
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "util.h"
+
+#define MAX_MANIFOLD_POINTS 4
+// Contact points closer than this are the same point, and points that separate or slide further are dropped
+#define CONTACT_THRESHOLD 0.02f
+
+
+typedef struct {
+    int feature;
+    Vector3 local_point;  // On the lower entity of the pair, in its local frame
+    Vector3 local_point_other;
+    Vector3 point;  // World position as of the last update
+    Vector3 offset;  // From the lower entity to the point, as of the last update
+    Vector3 offset_other;
+    float depth;
+    float normal_impulse;
+    Vector3 friction_impulse;  // Applied to the lower entity of the pair
+    float target_velocity;  // Normal velocity after bouncing, set when the solver starts
+} Contact;
+
+
+typedef struct {
+    unsigned long long key;  // Entity pair, 0 for free slots
+    bool touched;
+    Vector3 normal;  // Pushes the lower entity out of the other
+    int size;
+    Contact contacts[MAX_MANIFOLD_POINTS];
+    int axis;  // Separating or least overlapping axis of the last box test, tested first next tick
+    int touching_tick;  // Last update that found contact points, or an overlap for sensors
+    bool sensor;  // Pair with a sensor, which never has contact points
+} Manifold;
+
+
+typedef enum {
+    CONTACT_BEGIN,
+    CONTACT_STAY,
+    CONTACT_END
+} ContactEventType;
+
+
+typedef struct {
+    ContactEventType type;
+    Entity entity;  // Lower entity of the pair
+    Entity other;
+    int manifold;  // Index in the cache, valid until the next update
+    bool sensor;  // Enter and exit of a sensor, without contact points
+} ContactEvent;
+
+
+// Manifolds persist between ticks in a hash table keyed by the entity pair, so that the impulses
+// the solver accumulated in one tick can warm start the next. Manifolds of pairs that are not found
+// again by the narrowphase are dropped by the next prune.
+//
+// Each update also lists the touching pairs once in an event stream, in pair order, followed by the
+// pairs that stopped touching. The events of each collider are indexed from entity_events.
+typedef struct {
+    Manifold* manifolds;
+    Manifold* buffer;
+    int capacity;
+    int size;
+    int tick;
+    ContactEvent* events;
+    int events_size;
+    int events_capacity;
+    int* entity_events;  // Two per event, grouped by collider
+} ContactCache;
+
+
+ContactCache* ContactCache_create();
+
+void ContactCache_reserve(ContactCache* cache, int size);
+
+int ContactCache_find(ContactCache* cache, Entity entity, Entity other);
+
+Manifold* ContactCache_get(ContactCache* cache, int index);
+
+Contact* ContactCache_contact(ContactCache* cache, int index);
+
+void ContactCache_prune(ContactCache* cache);
+
+void ContactCache_clear_events(ContactCache* cache);
+
+void ContactCache_add_event(ContactCache* cache, int index);
+
+void ContactCache_end_events(ContactCache* cache);
+
+void ContactCache_destroy(ContactCache* cache);
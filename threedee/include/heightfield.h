@@ -0,0 +1,38 @@
+#pragma once
+
+#include "util.h"
+
+// Periods of the lowest octave of noise across a generated heightfield
+#define HEIGHTFIELD_NOISE_SCALE 4.0f
+
+
+typedef bool (*HeightfieldQueryCallback)(void* data, int triangle);
+
+
+// Regular grid of heights over the unit square, with x and z in [-0.5, 0.5] and heights in [0, 1]
+// in the local frame. Each cell is split into two triangles along its diagonal, so the triangles
+// near a point are found from its grid coordinates without a search structure.
+typedef struct Heightfield {
+    int width;  // Samples along x
+    int depth;  // Samples along z
+    float* heights;  // Rows of width samples, one per z
+    float min_height;
+    float max_height;
+} Heightfield;
+
+
+Heightfield* Heightfield_create(int width, int depth);
+
+Heightfield* Heightfield_create_perlin(int width, int depth, int octaves, float persistence);
+
+void Heightfield_update_bounds(Heightfield* heightfield);
+
+Triangle Heightfield_triangle(Heightfield* heightfield, int triangle);
+
+void Heightfield_bounds(Heightfield* heightfield, Vector3* min, Vector3* max);
+
+void Heightfield_query(Heightfield* heightfield, Vector3 min, Vector3 max, HeightfieldQueryCallback callback, void* data);
+
+float Heightfield_raycast(Heightfield* heightfield, Vector3 origin, Vector3 direction, float max_distance, Vector3* normal);
+
+void Heightfield_destroy(Heightfield* heightfield);
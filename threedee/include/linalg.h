@@ -111,6 +111,8 @@ Vector3 neg3(Vector3 v);
 
 Vector3 div3(float c, Vector3 v);
 
+Vector3 prod3(Vector3 v, Vector3 u);
+
 Vector2 proj(Vector2 a, Vector2 b);
 
 Vector3 proj3(Vector3 a, Vector3 b);
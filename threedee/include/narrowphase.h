@@ -0,0 +1,77 @@
+#pragma once
+
+#include "util.h"
+#include "broadphase.h"
+#include "systems/collision.h"
+
+// Pairs evaluated together by the vector kernels, the rest of a batch falls back to the scalar tests
+#define NARROWPHASE_LANES 4
+// Smallest number of pairs worth handing to another thread
+#define NARROWPHASE_BATCH_SIZE 256
+
+
+typedef enum {
+    BATCH_SPHERE_SPHERE,
+    BATCH_SPHERE_AABB,
+    BATCH_CAPSULE_AABB,
+    BATCH_COUNT
+} BatchType;
+
+
+// Inputs of a batch are stored one array per field, so that consecutive pairs fill the lanes
+typedef enum {
+    FIELD_X,  // Center of the sphere or capsule
+    FIELD_Y,
+    FIELD_Z,
+    FIELD_RADIUS,
+    FIELD_AXIS_X,  // Half of the capsule segment
+    FIELD_AXIS_Y,
+    FIELD_AXIS_Z,
+    FIELD_OTHER_X,  // Center of the other sphere or box
+    FIELD_OTHER_Y,
+    FIELD_OTHER_Z,
+    FIELD_OTHER_RADIUS,
+    FIELD_EXTENT_X,  // Half extents of the box
+    FIELD_EXTENT_Y,
+    FIELD_EXTENT_Z,
+    FIELD_SIGN,  // -1 if the pair was swapped to fit the batch
+    FIELD_COUNT
+} BatchField;
+
+
+typedef struct {
+    int size;
+    int capacity;
+    int* indices;  // Pair of each entry, where its result goes in the contact stream
+    float* fields[FIELD_COUNT];
+} NarrowphaseBatch;
+
+
+// Candidate pairs are grouped by the types of their shapes. Batched pairs are tested several at a
+// time with SSE where it is available, and everything else goes through get_penetration. The tests
+// are split across the thread pool. Each job only writes the results and axes of its own pairs, the
+// results go to the contact stream in pair order, so they do not depend on the number of threads.
+typedef struct {
+    NarrowphaseBatch batches[BATCH_COUNT];
+    unsigned long long* keys;  // Candidate pairs by collider index, sorted so that the stream order is stable
+    CollisionPair* pairs;  // Pair of each result in the contact stream
+    int** axes;  // Separating axis cache of each pair, NULL if the shapes do not use one
+    int* general;  // Pairs of other shapes, tested one at a time
+    int general_size;
+    int* sensors;  // Pairs with a sensor, which only test whether the shapes overlap
+    int sensors_size;
+    Penetration* penetrations;  // Contact stream, one result per pair
+    int capacity;
+    int size;
+} Narrowphase;
+
+
+Narrowphase* Narrowphase_create();
+
+void Narrowphase_reset(Narrowphase* narrowphase, int size);
+
+void Narrowphase_add(Narrowphase* narrowphase, int index, Entity entity, Entity other, int* axis);
+
+void Narrowphase_run(Narrowphase* narrowphase);
+
+void Narrowphase_destroy(Narrowphase* narrowphase);
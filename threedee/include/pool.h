@@ -0,0 +1,27 @@
+#pragma once
+
+
+// Fixed-size block allocator. Blocks are carved from chunks allocated on demand and recycled
+// through an intrusive free list, so steady-state allocation never reaches malloc.
+typedef struct {
+    int block_size;
+    int chunk_blocks;  // Blocks per chunk
+    void** chunks;
+    int chunks_size;
+    void* free_list;
+    int used;          // Blocks currently handed out
+    int peak;          // Highest value of used so far
+    int allocations;
+    int frees;
+} Pool;
+
+
+Pool* Pool_create(int block_size, int chunk_blocks);
+
+void* Pool_alloc(Pool* pool);
+
+void Pool_free(Pool* pool, void* block);
+
+void Pool_print_stats(Pool* pool, const char* name);
+
+void Pool_destroy(Pool* pool);
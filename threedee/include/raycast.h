@@ -25,3 +25,7 @@ typedef struct {
 
 
 Hit raycast(Ray ray, ColliderGroup group);
+
+// Moves a sphere along motion and returns the first static collider it hits, with the distance as
+// a fraction of motion
+Hit sweep_sphere(Sphere sphere, Vector3 motion, Entity entity);
@@ -4,6 +4,7 @@
 #include <SDL3_mixer/SDL_mixer.h>
 
 #include "util.h"
+#include "bvh.h"
 
 
 #define MAX_TEXTURES 128
@@ -31,6 +32,7 @@ typedef struct MeshData {
     int max_instances;
     SDL_GPUTransferBuffer* instance_transfer_buffer;
     int instance_size;
+    BVH* bvh;  // Triangles of the mesh for mesh colliders, in its local frame
 } MeshData;
 
 
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "component.h"
+#include "commandbuffer.h"
+#include "broadphase.h"
+#include "contactcache.h"
+#include "narrowphase.h"
 
 
 typedef struct Scene {
@@ -9,6 +13,10 @@ typedef struct Scene {
     Entity player;
     Entity weather;
     ComponentData* components;
+    CommandBuffer* commands;  // Structural changes from outside the systems, applied after theirs at the end of each update
+    Broadphase* broadphase;
+    Narrowphase* narrowphase;
+    ContactCache* contacts;  // Solver impulses carried over between ticks
 } Scene;
 
 
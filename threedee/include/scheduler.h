@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "commandbuffer.h"
+#include "threadpool.h"
+
+#define MAX_SYSTEMS 32
+
+
+// Structural changes go to the command buffer of the system instead of being made directly
+typedef void (*SystemUpdate)(float time_step, CommandBuffer* commands);
+
+
+// Component access is given as masks of COMPONENT_MASK bits. Systems running at the same time
+// must not make structural changes directly, only through the command buffer they are given.
+typedef struct {
+    const char* name;
+    SystemUpdate update;
+    unsigned int reads;
+    unsigned int writes;
+    bool main_thread;  // Needs to run on the calling thread, e.g. for SDL input
+} System;
+
+
+// Systems run in the order they were added unless their component access does not conflict,
+// in which case they are grouped into the same stage and run concurrently.
+typedef struct {
+    System systems[MAX_SYSTEMS];
+    int stages[MAX_SYSTEMS];  // Stage of each system
+    CommandBuffer* commands[MAX_SYSTEMS];  // Recorded by each system, played back in system order
+    int size;
+    int stages_size;
+    ThreadPool* pool;
+} Scheduler;
+
+
+Scheduler* Scheduler_create(ThreadPool* pool);
+
+void Scheduler_add(Scheduler* scheduler, System system);
+
+void Scheduler_run(Scheduler* scheduler, float time_step);
+
+void Scheduler_execute_commands(Scheduler* scheduler);
+
+void Scheduler_destroy(Scheduler* scheduler);
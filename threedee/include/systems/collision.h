@@ -1,13 +1,45 @@
 #pragma once
 
 #include "util.h"
+#include "contactcache.h"
+#include "components/collider.h"
 
 
+#define MAX_CONTACT_POINTS 4
+
+
+typedef struct {
+    Vector3 point;  // Halfway between the surfaces
+    float depth;
+    int feature;
+} ContactPoint;
+
 typedef struct {
     bool valid;
     Vector3 overlap;
     Vector3 contact_point;
+    int feature;  // Identifies the contact between ticks, such as the separating axis of two cuboids
+    int contacts_size;  // Zero if the shapes only report the single contact point
+    ContactPoint contacts[MAX_CONTACT_POINTS];
 } Penetration;
 
 
+Penetration penetration_sphere_sphere(Sphere sphere1, Sphere sphere2);
+
+Penetration penetration_sphere_aabb(Sphere sphere, AABB aabb);
+
+Vector3 closest_point_on_segment(Vector3 p0, Vector3 p1, Vector3 point);
+
+Vector3 closest_point_on_aabb(AABB aabb, Vector3 point);
+
+Penetration get_penetration(Entity i, Entity j);
+
+Penetration get_penetration_cached(Entity i, Entity j, int* axis);
+
+bool test_overlap(Entity i, Entity j, int* axis);
+
+ContactEvent* get_contact_event(ColliderComponent* collider, int index);
+
+Collision get_collision(ContactEvent* event, Entity entity, int point);
+
 void update_collisions();
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include <SDL3/SDL.h>
+
+#define MAX_PARALLEL_RANGES 64
+
+
+typedef void (*JobFunction)(void* data);
+typedef void (*RangeFunction)(void* data, int start, int end);
+
+
+typedef struct {
+    JobFunction function;
+    void* data;
+    int* pending;  // Counter of the batch this job belongs to
+} Job;
+
+
+// Worker threads pulling jobs from a shared queue. Callers group jobs by pointing them at the same
+// pending counter and wait on that counter, running queued jobs themselves in the meantime, so
+// waiting from inside a job does not deadlock.
+typedef struct {
+    SDL_Thread** threads;
+    int threads_size;
+    Job* jobs;  // Ring buffer
+    int jobs_head;
+    int jobs_size;
+    int jobs_capacity;
+    bool quit;
+    SDL_Mutex* mutex;
+    SDL_Condition* job_available;
+    SDL_Condition* job_done;
+} ThreadPool;
+
+
+extern ThreadPool* thread_pool;
+
+
+ThreadPool* ThreadPool_create(int threads);
+
+void ThreadPool_submit(ThreadPool* pool, JobFunction function, void* data, int* pending);
+
+void ThreadPool_wait(ThreadPool* pool, int* pending);
+
+void ThreadPool_parallel_for(ThreadPool* pool, int start, int end, int min_batch, RangeFunction function, void* data);
+
+void ThreadPool_destroy(ThreadPool* pool);
@@ -37,6 +37,15 @@
 typedef int Entity;
 #define NULL_ENTITY -1
 
+// Entity handles pack a slot index in the low bits and a generation counter in the high bits,
+// so a handle to a destroyed entity never matches the entity that reuses its slot.
+#define ENTITY_INDEX_BITS 20
+#define ENTITY_INDEX_MASK ((1 << ENTITY_INDEX_BITS) - 1)
+#define ENTITY_GENERATION_MASK ((1 << (31 - ENTITY_INDEX_BITS)) - 1)
+#define ENTITY_INDEX(entity) ((entity) & ENTITY_INDEX_MASK)
+#define ENTITY_GENERATION(entity) (((entity) >> ENTITY_INDEX_BITS) & ENTITY_GENERATION_MASK)
+#define ENTITY_HANDLE(index, generation) (((generation) << ENTITY_INDEX_BITS) | (index))
+
 typedef struct {
     int w;
     int h;
@@ -92,7 +101,30 @@ typedef struct {
 } AABB;
 
 typedef struct {
-    Vector3* points;
+    Vector3 a;
+    Vector3 b;
+    Vector3 c;
+} Triangle;
+
+typedef struct {
+    Vector3 center;
+    Vector3 scale;
+    Quaternion rotation;
+    int mesh_index;  // Triangles come from the BVH built when the mesh was loaded
+} MeshShape;
+
+typedef struct {
+    Vector3 center;
+    Vector3 scale;
+    Quaternion rotation;
+    struct Heightfield* heightfield;  // Owned by the collider
+} HeightfieldShape;
+
+#define MAX_POLYGON_POINTS 8
+
+typedef struct {
+    Vector3 points[MAX_POLYGON_POINTS];
+    int features[MAX_POLYGON_POINTS];  // Identifies where each point came from
     int size;
 } PolygonShape;
 
@@ -102,6 +134,8 @@ typedef union {
     Cuboid cuboid;
     Capsule capsule;
     AABB aabb;
+    MeshShape mesh;
+    HeightfieldShape heightfield;
 } Shape;
 
 #define COLOR_NONE get_color(0.0f, 0.0f, 0.0f, 0.0f)
@@ -197,3 +231,5 @@ void get_ellipse_points(Vector2 position, float major, float minor, float angle,
 void get_rect_corners(Vector2 position, float angle, float width, float height, Vector2* corners);
 
 float map_to_range(int x, int min_x, int max_x, float min_y, float max_y);
+
+float ray_triangle_distance(Triangle triangle, Vector3 origin, Vector3 direction);
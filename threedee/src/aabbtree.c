@@ -0,0 +1,373 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "aabbtree.h"
+#include "linalg.h"
+
+
+static float surface_area(Vector3 min, Vector3 max) {
+    Vector3 d = diff3(max, min);
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+
+static Vector3 min3(Vector3 a, Vector3 b) {
+    return (Vector3) { fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z) };
+}
+
+
+static Vector3 max3(Vector3 a, Vector3 b) {
+    return (Vector3) { fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z) };
+}
+
+
+static bool contains(TreeNode* node, Vector3 min, Vector3 max) {
+    return node->min.x <= min.x && node->min.y <= min.y && node->min.z <= min.z
+        && max.x <= node->max.x && max.y <= node->max.y && max.z <= node->max.z;
+}
+
+
+static bool overlaps(TreeNode* node, Vector3 min, Vector3 max) {
+    return node->min.x <= max.x && min.x <= node->max.x
+        && node->min.y <= max.y && min.y <= node->max.y
+        && node->min.z <= max.z && min.z <= node->max.z;
+}
+
+
+static void add_free_nodes(AABBTree* tree, int start) {
+    for (int i = start; i < tree->capacity; i++) {
+        tree->nodes[i].parent = (i + 1 < tree->capacity) ? i + 1 : tree->free_list;
+        tree->nodes[i].height = -1;
+    }
+    tree->free_list = start;
+}
+
+
+AABBTree* AABBTree_create() {
+    AABBTree* tree = malloc(sizeof(AABBTree));
+    tree->capacity = 64;
+    tree->nodes = malloc(sizeof(TreeNode) * tree->capacity);
+    tree->root = NULL_NODE;
+    tree->free_list = NULL_NODE;
+    tree->leaves = 0;
+    add_free_nodes(tree, 0);
+    return tree;
+}
+
+
+static int allocate_node(AABBTree* tree) {
+    if (tree->free_list == NULL_NODE) {
+        int start = tree->capacity;
+        tree->capacity *= 2;
+        tree->nodes = realloc(tree->nodes, sizeof(TreeNode) * tree->capacity);
+        add_free_nodes(tree, start);
+    }
+
+    int node = tree->free_list;
+    tree->free_list = tree->nodes[node].parent;
+    tree->nodes[node] = (TreeNode) {
+        .parent = NULL_NODE,
+        .left = NULL_NODE,
+        .right = NULL_NODE,
+        .height = 0,
+        .entity = NULL_ENTITY
+    };
+    return node;
+}
+
+
+static void free_node(AABBTree* tree, int node) {
+    tree->nodes[node].parent = tree->free_list;
+    tree->nodes[node].height = -1;
+    tree->free_list = node;
+}
+
+
+static void fit_node(AABBTree* tree, int node) {
+    TreeNode* n = &tree->nodes[node];
+    TreeNode* left = &tree->nodes[n->left];
+    TreeNode* right = &tree->nodes[n->right];
+    n->min = min3(left->min, right->min);
+    n->max = max3(left->max, right->max);
+    n->height = 1 + maxi(left->height, right->height);
+}
+
+
+static int balance(AABBTree* tree, int a) {
+    // Rotates the taller grandchild up if the children of a differ in height by more than one.
+    // Returns the node now in the place of a.
+    TreeNode* nodes = tree->nodes;
+    if (nodes[a].left == NULL_NODE || nodes[a].height < 2) {
+        return a;
+    }
+
+    int b = nodes[a].left;
+    int c = nodes[a].right;
+    int difference = nodes[c].height - nodes[b].height;
+
+    if (difference > 1 || difference < -1) {
+        // Make c the taller child and b the shorter one
+        bool right_taller = difference > 1;
+        if (!right_taller) {
+            int tmp = b;
+            b = c;
+            c = tmp;
+        }
+
+        int f = nodes[c].left;
+        int g = nodes[c].right;
+
+        // Swap a and c
+        nodes[c].parent = nodes[a].parent;
+        nodes[a].parent = c;
+        if (nodes[c].parent != NULL_NODE) {
+            if (nodes[nodes[c].parent].left == a) {
+                nodes[nodes[c].parent].left = c;
+            } else {
+                nodes[nodes[c].parent].right = c;
+            }
+        } else {
+            tree->root = c;
+        }
+
+        // Keep the taller grandchild under c, move the shorter one under a
+        int taller = nodes[f].height > nodes[g].height ? f : g;
+        int shorter = taller == f ? g : f;
+        nodes[c].left = a;
+        nodes[c].right = taller;
+        if (right_taller) {
+            nodes[a].right = shorter;
+        } else {
+            nodes[a].left = shorter;
+        }
+        nodes[shorter].parent = a;
+
+        fit_node(tree, a);
+        fit_node(tree, c);
+        return c;
+    }
+
+    return a;
+}
+
+
+static void refit_ancestors(AABBTree* tree, int node) {
+    while (node != NULL_NODE) {
+        fit_node(tree, node);
+        node = balance(tree, node);
+        node = tree->nodes[node].parent;
+    }
+}
+
+
+static void insert_leaf(AABBTree* tree, int leaf) {
+    TreeNode* nodes = tree->nodes;
+    if (tree->root == NULL_NODE) {
+        tree->root = leaf;
+        nodes[leaf].parent = NULL_NODE;
+        return;
+    }
+
+    // Descend towards the sibling that grows the total surface area least
+    Vector3 min = nodes[leaf].min;
+    Vector3 max = nodes[leaf].max;
+    int index = tree->root;
+    while (nodes[index].left != NULL_NODE) {
+        int left = nodes[index].left;
+        int right = nodes[index].right;
+
+        float area = surface_area(nodes[index].min, nodes[index].max);
+        float combined_area = surface_area(min3(nodes[index].min, min), max3(nodes[index].max, max));
+
+        // Cost of making a new parent for this node and the leaf, and the minimum cost of pushing
+        // the leaf further down, which grows every node on the way
+        float cost = 2.0f * combined_area;
+        float inheritance_cost = 2.0f * (combined_area - area);
+
+        float cost_left = surface_area(min3(nodes[left].min, min), max3(nodes[left].max, max)) + inheritance_cost;
+        if (nodes[left].left != NULL_NODE) {
+            cost_left -= surface_area(nodes[left].min, nodes[left].max);
+        }
+        float cost_right = surface_area(min3(nodes[right].min, min), max3(nodes[right].max, max)) + inheritance_cost;
+        if (nodes[right].left != NULL_NODE) {
+            cost_right -= surface_area(nodes[right].min, nodes[right].max);
+        }
+
+        if (cost < cost_left && cost < cost_right) {
+            break;
+        }
+        index = cost_left < cost_right ? left : right;
+    }
+
+    int sibling = index;
+    int old_parent = nodes[sibling].parent;
+    int new_parent = allocate_node(tree);
+    nodes = tree->nodes;
+
+    nodes[new_parent].parent = old_parent;
+    nodes[new_parent].left = sibling;
+    nodes[new_parent].right = leaf;
+    nodes[sibling].parent = new_parent;
+    nodes[leaf].parent = new_parent;
+
+    if (old_parent != NULL_NODE) {
+        if (nodes[old_parent].left == sibling) {
+            nodes[old_parent].left = new_parent;
+        } else {
+            nodes[old_parent].right = new_parent;
+        }
+    } else {
+        tree->root = new_parent;
+    }
+
+    refit_ancestors(tree, new_parent);
+}
+
+
+static void remove_leaf(AABBTree* tree, int leaf) {
+    TreeNode* nodes = tree->nodes;
+    if (leaf == tree->root) {
+        tree->root = NULL_NODE;
+        return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grandparent = nodes[parent].parent;
+    int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+    // Replace the parent with the sibling
+    if (grandparent != NULL_NODE) {
+        if (nodes[grandparent].left == parent) {
+            nodes[grandparent].left = sibling;
+        } else {
+            nodes[grandparent].right = sibling;
+        }
+        nodes[sibling].parent = grandparent;
+        free_node(tree, parent);
+        refit_ancestors(tree, grandparent);
+    } else {
+        tree->root = sibling;
+        nodes[sibling].parent = NULL_NODE;
+        free_node(tree, parent);
+    }
+}
+
+
+int AABBTree_insert(AABBTree* tree, Entity entity, Vector3 min, Vector3 max) {
+    int leaf = allocate_node(tree);
+    Vector3 margin = vec3(TREE_MARGIN, TREE_MARGIN, TREE_MARGIN);
+    tree->nodes[leaf].min = diff3(min, margin);
+    tree->nodes[leaf].max = sum3(max, margin);
+    tree->nodes[leaf].entity = entity;
+    insert_leaf(tree, leaf);
+    tree->leaves++;
+    return leaf;
+}
+
+
+void AABBTree_remove(AABBTree* tree, int leaf) {
+    remove_leaf(tree, leaf);
+    free_node(tree, leaf);
+    tree->leaves--;
+}
+
+
+bool AABBTree_move(AABBTree* tree, int leaf, Vector3 min, Vector3 max) {
+    // Returns true if the leaf had to be reinserted
+    if (contains(&tree->nodes[leaf], min, max)) {
+        return false;
+    }
+
+    remove_leaf(tree, leaf);
+    Vector3 margin = vec3(TREE_MARGIN, TREE_MARGIN, TREE_MARGIN);
+    tree->nodes[leaf].min = diff3(min, margin);
+    tree->nodes[leaf].max = sum3(max, margin);
+    insert_leaf(tree, leaf);
+    return true;
+}
+
+
+void AABBTree_query(AABBTree* tree, Vector3 min, Vector3 max, TreeQueryCallback callback, void* data) {
+    // Depth is bounded by the balancing, so a fixed stack is enough
+    int stack[256];
+    int stack_size = 0;
+
+    if (tree->root != NULL_NODE) {
+        stack[stack_size++] = tree->root;
+    }
+
+    while (stack_size > 0) {
+        TreeNode* node = &tree->nodes[stack[--stack_size]];
+        if (!overlaps(node, min, max)) continue;
+
+        if (node->left == NULL_NODE) {
+            if (!callback(data, node->entity)) {
+                return;
+            }
+        } else {
+            stack[stack_size++] = node->left;
+            stack[stack_size++] = node->right;
+        }
+    }
+}
+
+
+static float ray_distance(TreeNode* node, Vector3 origin, Vector3 inv_direction, float max_distance) {
+    // Slab test, returns INFINITY on a miss
+    float t_min = 0.0f;
+    float t_max = max_distance;
+    for (int i = 0; i < 3; i++) {
+        float o = vec3_get(origin, i);
+        float inv_d = vec3_get(inv_direction, i);
+        float t1 = (vec3_get(node->min, i) - o) * inv_d;
+        float t2 = (vec3_get(node->max, i) - o) * inv_d;
+        if (isnan(t1) || isnan(t2)) {
+            // Ray parallel to the slab and starting on its boundary
+            continue;
+        }
+        t_min = fmaxf(t_min, fminf(t1, t2));
+        t_max = fminf(t_max, fmaxf(t1, t2));
+    }
+    return t_min <= t_max ? t_min : INFINITY;
+}
+
+
+void AABBTree_raycast(AABBTree* tree, Vector3 origin, Vector3 direction, float max_distance,
+        TreeRaycastCallback callback, void* data) {
+    // The callback returns the distance to the closest hit so far, which prunes farther nodes
+    Vector3 inv_direction = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+
+    int stack[256];
+    int stack_size = 0;
+
+    if (tree->root != NULL_NODE) {
+        stack[stack_size++] = tree->root;
+    }
+
+    while (stack_size > 0) {
+        TreeNode* node = &tree->nodes[stack[--stack_size]];
+        if (ray_distance(node, origin, inv_direction, max_distance) == INFINITY) continue;
+
+        if (node->left == NULL_NODE) {
+            max_distance = fminf(max_distance, callback(data, node->entity, max_distance));
+        } else {
+            stack[stack_size++] = node->left;
+            stack[stack_size++] = node->right;
+        }
+    }
+}
+
+
+void AABBTree_clear(AABBTree* tree) {
+    tree->root = NULL_NODE;
+    tree->leaves = 0;
+    tree->free_list = NULL_NODE;
+    add_free_nodes(tree, 0);
+}
+
+
+void AABBTree_destroy(AABBTree* tree) {
+    free(tree->nodes);
+    free(tree);
+}
@@ -65,6 +65,69 @@ void resize_game_window() {
 }
 
 
+static void run_input(float time_step, CommandBuffer* commands) {
+    (void) time_step;
+    (void) commands;
+    input_players();
+}
+
+
+static void run_transforms(float time_step, CommandBuffer* commands) {
+    (void) time_step;
+    (void) commands;
+    update_transforms();
+}
+
+
+static void run_collisions(float time_step, CommandBuffer* commands) {
+    (void) time_step;
+    (void) commands;
+    update_collisions();
+}
+
+
+static void run_physics(float time_step, CommandBuffer* commands) {
+    (void) commands;
+    update_physics(time_step);
+}
+
+
+void init_systems() {
+    #ifdef __EMSCRIPTEN__
+    thread_pool = ThreadPool_create(0);
+    #else
+    thread_pool = ThreadPool_create(SDL_GetNumLogicalCPUCores() - 1);
+    #endif
+
+    app.scheduler = Scheduler_create(thread_pool);
+    Scheduler_add(app.scheduler, (System) {
+        .name = "input",
+        .update = run_input,
+        .reads = COMPONENT_MASK(COMPONENT_CONTROLLER) | COMPONENT_MASK(COMPONENT_COLLIDER),
+        .writes = COMPONENT_MASK(COMPONENT_PLAYER) | COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_RIGIDBODY),
+        .main_thread = true
+    });
+    Scheduler_add(app.scheduler, (System) {
+        .name = "transforms",
+        .update = run_transforms,
+        .reads = 0,
+        .writes = COMPONENT_MASK(COMPONENT_TRANSFORM)
+    });
+    Scheduler_add(app.scheduler, (System) {
+        .name = "collisions",
+        .update = run_collisions,
+        .reads = COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_RIGIDBODY),
+        .writes = COMPONENT_MASK(COMPONENT_COLLIDER)
+    });
+    Scheduler_add(app.scheduler, (System) {
+        .name = "physics",
+        .update = run_physics,
+        .reads = COMPONENT_MASK(COMPONENT_COLLIDER),
+        .writes = COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_RIGIDBODY)
+    });
+}
+
+
 void init() {
     setbuf(stdout, NULL);
 
@@ -109,11 +172,16 @@ void init() {
     create_scene();
 
     init_physics();
+    init_systems();
 }
 
 
 void quit() {
+    // Components release their own resources, e.g. lights and heightfields, before the device goes
+    ComponentData_clear();
     free(app.fps);
+    Scheduler_destroy(app.scheduler);
+    ThreadPool_destroy(thread_pool);
     destroy_game_window();
 
     Mix_CloseAudio();
@@ -165,9 +233,11 @@ void update(float time_step) {
 
     AppState state = app.state;
 
-    input_players();
-    update_collisions();
-    update_physics(time_step);
+    Scheduler_run(app.scheduler, time_step);
+    // Collisions and physics have read the journal, changes made from here on are seen next tick
+    clear_changes();
+    Scheduler_execute_commands(app.scheduler);
+    CommandBuffer_execute(scene->commands);
 
     if (state != app.state) {
         previous_state = state;
@@ -176,6 +246,7 @@ void update(float time_step) {
 
 
 void draw() {
+    update_transforms();
     draw_entities();
     render();
 }
@@ -0,0 +1,500 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "broadphase.h"
+#include "scene.h"
+
+
+typedef struct {
+    Broadphase* broadphase;
+    Proxy* proxy;
+} TreeQuery;
+
+
+Broadphase* Broadphase_create(BroadphaseType type) {
+    Broadphase* broadphase = malloc(sizeof(Broadphase));
+    broadphase->type = type;
+    broadphase->proxies = ComponentArray_create(sizeof(Proxy));
+    broadphase->tree = AABBTree_create();
+    broadphase->static_proxies = ComponentArray_create(sizeof(Proxy));
+    broadphase->static_tree = AABBTree_create();
+    broadphase->endpoints_capacity = 64;
+    broadphase->endpoints = malloc(sizeof(Endpoint) * broadphase->endpoints_capacity);
+    broadphase->endpoints_size = 0;
+    broadphase->active_capacity = 32;
+    broadphase->active = malloc(sizeof(Proxy*) * broadphase->active_capacity);
+    broadphase->pairs_capacity = 64;
+    broadphase->pairs = malloc(sizeof(CollisionPair) * broadphase->pairs_capacity);
+    broadphase->pairs_size = 0;
+    broadphase->axis = 0;
+    broadphase->cell_size = GRID_CELL_SIZE;
+    broadphase->cells_capacity = 64;
+    broadphase->cells = malloc(sizeof(GridCell) * broadphase->cells_capacity);
+    broadphase->sorted_cells = malloc(sizeof(GridCell) * broadphase->cells_capacity);
+    broadphase->cells_size = 0;
+    broadphase->buckets_capacity = 64;
+    broadphase->buckets = malloc(sizeof(int) * (broadphase->buckets_capacity + 1));
+    return broadphase;
+}
+
+
+static void add_endpoint(Broadphase* broadphase, Entity entity, bool max) {
+    if (broadphase->endpoints_size == broadphase->endpoints_capacity) {
+        broadphase->endpoints_capacity *= 2;
+        broadphase->endpoints = realloc(broadphase->endpoints, sizeof(Endpoint) * broadphase->endpoints_capacity);
+    }
+    broadphase->endpoints[broadphase->endpoints_size] = (Endpoint) {
+        .entity = entity,
+        .value = 0.0f,
+        .max = max
+    };
+    broadphase->endpoints_size++;
+}
+
+
+static void add_pair(Broadphase* broadphase, Entity entity, Entity other) {
+    if (broadphase->pairs_size == broadphase->pairs_capacity) {
+        broadphase->pairs_capacity *= 2;
+        broadphase->pairs = realloc(broadphase->pairs, sizeof(CollisionPair) * broadphase->pairs_capacity);
+    }
+    broadphase->pairs[broadphase->pairs_size] = (CollisionPair) {
+        .entity = entity,
+        .other = other
+    };
+    broadphase->pairs_size++;
+}
+
+
+static int compare_endpoints(const void* a, const void* b) {
+    const Endpoint* endpoint_a = a;
+    const Endpoint* endpoint_b = b;
+    if (endpoint_a->value != endpoint_b->value) {
+        return endpoint_a->value < endpoint_b->value ? -1 : 1;
+    }
+    return endpoint_a->max - endpoint_b->max;
+}
+
+
+static void remove_proxy(ComponentArray* proxies, AABBTree* tree, Entity entity) {
+    Proxy* proxy = ComponentArray_get(proxies, entity);
+    if (proxy) {
+        AABBTree_remove(tree, proxy->node);
+        ComponentArray_remove(proxies, entity);
+    }
+}
+
+
+static void update_proxies(Broadphase* broadphase, ComponentArray* colliders) {
+    // Drop colliders that were removed since the last update first, so that a new entity reusing
+    // the index of a removed one does not inherit its proxy
+    for (int k = broadphase->proxies->size - 1; k >= 0; k--) {
+        Proxy* proxy = ComponentArray_at(broadphase->proxies, k);
+        if (!ComponentArray_has(colliders, proxy->entity)) {
+            remove_proxy(broadphase->proxies, broadphase->tree, proxy->entity);
+        }
+    }
+    for (int k = broadphase->static_proxies->size - 1; k >= 0; k--) {
+        Proxy* proxy = ComponentArray_at(broadphase->static_proxies, k);
+        if (!ComponentArray_has(colliders, proxy->entity)) {
+            remove_proxy(broadphase->static_proxies, broadphase->static_tree, proxy->entity);
+        }
+    }
+
+    for (int k = 0; k < colliders->size; k++) {
+        Entity entity = colliders->entities[k];
+        BodyType body = get_body_type(entity);
+
+        ComponentArray* proxies = broadphase->proxies;
+        AABBTree* tree = broadphase->tree;
+        Proxy* proxy = ComponentArray_get(proxies, entity);
+        Proxy* static_proxy = ComponentArray_get(broadphase->static_proxies, entity);
+        ColliderComponent* collider = get_component(entity, COMPONENT_COLLIDER);
+
+        // Adding or removing a rigid body moves the collider to the other partition
+        if (body == BODY_STATIC) {
+            if (proxy) {
+                remove_proxy(proxies, tree, entity);
+            }
+            if (static_proxy && !collider->shape_dirty) {
+                continue;
+            }
+            proxies = broadphase->static_proxies;
+            tree = broadphase->static_tree;
+            proxy = static_proxy;
+        } else if (static_proxy) {
+            remove_proxy(broadphase->static_proxies, broadphase->static_tree, entity);
+        }
+
+        AABB bounds = collider->bounds;
+        Vector3 h = bounds.half_extents;
+        float margin = BROADPHASE_MARGIN + BROADPHASE_RELATIVE_MARGIN * (h.x + h.y + h.z);
+        h = sum3(h, vec3(margin, margin, margin));
+        Vector3 min = diff3(bounds.center, h);
+        Vector3 max = sum3(bounds.center, h);
+
+        if (!proxy) {
+            proxy = ComponentArray_add(proxies, entity);
+            proxy->node = AABBTree_insert(tree, entity, min, max);
+            if (broadphase->type == BROADPHASE_SAP && body != BODY_STATIC) {
+                add_endpoint(broadphase, entity, false);
+                add_endpoint(broadphase, entity, true);
+            }
+        } else {
+            AABBTree_move(tree, proxy->node, min, max);
+        }
+
+        proxy->min = min;
+        proxy->max = max;
+        proxy->entity = entity;
+        proxy->group = collider->group;
+        proxy->body = body;
+
+        // The shape was refreshed by update_collider_shapes before the broadphase
+        collider->shape_dirty = false;
+    }
+}
+
+
+static void update_endpoints(Broadphase* broadphase) {
+    // Sweep along the axis with the largest variance, ignoring unbounded planes
+    Vector3 sum = zeros3();
+    Vector3 sum_squares = zeros3();
+    int count = 0;
+    for (int k = 0; k < broadphase->proxies->size; k++) {
+        Proxy* proxy = ComponentArray_at(broadphase->proxies, k);
+        if (proxy->max.x - proxy->min.x >= PLANE_BOUNDS) continue;
+
+        Vector3 center = mult3(0.5f, sum3(proxy->min, proxy->max));
+        sum = sum3(sum, center);
+        sum_squares = sum3(sum_squares, prod3(center, center));
+        count++;
+    }
+
+    Vector3 variance = diff3(mult3(count, sum_squares), prod3(sum, sum));
+    int axis = 0;
+    if (variance.y > vec3_get(variance, axis)) axis = 1;
+    if (variance.z > vec3_get(variance, axis)) axis = 2;
+    bool resort = (axis != broadphase->axis);
+    broadphase->axis = axis;
+
+    int size = 0;
+    for (int i = 0; i < broadphase->endpoints_size; i++) {
+        Endpoint endpoint = broadphase->endpoints[i];
+        Proxy* proxy = ComponentArray_get(broadphase->proxies, endpoint.entity);
+        if (!proxy) {
+            continue;
+        }
+        endpoint.value = vec3_get(endpoint.max ? proxy->max : proxy->min, axis);
+        broadphase->endpoints[size] = endpoint;
+        size++;
+    }
+    broadphase->endpoints_size = size;
+
+    // Resort fully only when the axis changes, otherwise the order is nearly right already
+    if (resort) {
+        qsort(broadphase->endpoints, broadphase->endpoints_size, sizeof(Endpoint), compare_endpoints);
+    }
+}
+
+
+static void sort_endpoints(Broadphase* broadphase) {
+    // Insertion sort, nearly linear since the order changes little between updates.
+    // Minimum endpoints go first on ties so that touching intervals count as overlapping.
+    Endpoint* endpoints = broadphase->endpoints;
+    for (int i = 1; i < broadphase->endpoints_size; i++) {
+        Endpoint endpoint = endpoints[i];
+        int j = i - 1;
+        while (j >= 0 && (endpoints[j].value > endpoint.value
+                || (endpoints[j].value == endpoint.value && endpoints[j].max && !endpoint.max))) {
+            endpoints[j + 1] = endpoints[j];
+            j--;
+        }
+        endpoints[j + 1] = endpoint;
+    }
+}
+
+
+static bool overlaps(Proxy* proxy, Proxy* other) {
+    return proxy->min.x <= other->max.x && other->min.x <= proxy->max.x
+        && proxy->min.y <= other->max.y && other->min.y <= proxy->max.y
+        && proxy->min.z <= other->max.z && other->min.z <= proxy->max.z;
+}
+
+
+static bool can_collide(Proxy* proxy, Proxy* other) {
+    // Only dynamic bodies respond to collisions
+    if (proxy->body != BODY_DYNAMIC && other->body != BODY_DYNAMIC) {
+        return false;
+    }
+    return groups_collide(proxy->group, other->group) && overlaps(proxy, other);
+}
+
+
+static void sweep(Broadphase* broadphase) {
+    update_endpoints(broadphase);
+    sort_endpoints(broadphase);
+
+    int active_size = 0;
+    for (int i = 0; i < broadphase->endpoints_size; i++) {
+        Endpoint endpoint = broadphase->endpoints[i];
+        Proxy* proxy = ComponentArray_get(broadphase->proxies, endpoint.entity);
+
+        if (endpoint.max) {
+            for (int j = 0; j < active_size; j++) {
+                if (broadphase->active[j] == proxy) {
+                    broadphase->active[j] = broadphase->active[active_size - 1];
+                    active_size--;
+                    break;
+                }
+            }
+            continue;
+        }
+
+        // Every active interval overlaps this one on the sweep axis
+        for (int j = 0; j < active_size; j++) {
+            Proxy* other = broadphase->active[j];
+            if (can_collide(proxy, other)) {
+                add_pair(broadphase, proxy->entity, other->entity);
+            }
+        }
+
+        if (active_size == broadphase->active_capacity) {
+            broadphase->active_capacity *= 2;
+            broadphase->active = realloc(broadphase->active, sizeof(Proxy*) * broadphase->active_capacity);
+        }
+        broadphase->active[active_size] = proxy;
+        active_size++;
+    }
+}
+
+
+static bool cell_range(Broadphase* broadphase, Proxy* proxy, int min[3], int max[3]) {
+    int count = 1;
+    for (int i = 0; i < 3; i++) {
+        float lower = floorf(vec3_get(proxy->min, i) / broadphase->cell_size);
+        float upper = floorf(vec3_get(proxy->max, i) / broadphase->cell_size);
+        if (upper - lower >= GRID_MAX_CELLS) {
+            return false;
+        }
+        min[i] = (int) lower;
+        max[i] = (int) upper;
+        count *= max[i] - min[i] + 1;
+    }
+    return count <= GRID_MAX_CELLS;
+}
+
+
+static unsigned int hash_cell(GridCell cell) {
+    return ((unsigned int) cell.x * 73856093u) ^ ((unsigned int) cell.y * 19349663u)
+        ^ ((unsigned int) cell.z * 83492791u);
+}
+
+
+static void add_cell(Broadphase* broadphase, int x, int y, int z, int proxy) {
+    if (broadphase->cells_size == broadphase->cells_capacity) {
+        broadphase->cells_capacity *= 2;
+        broadphase->cells = realloc(broadphase->cells, sizeof(GridCell) * broadphase->cells_capacity);
+        broadphase->sorted_cells = realloc(broadphase->sorted_cells, sizeof(GridCell) * broadphase->cells_capacity);
+    }
+    broadphase->cells[broadphase->cells_size] = (GridCell) { x, y, z, proxy };
+    broadphase->cells_size++;
+}
+
+
+static int sort_cells(Broadphase* broadphase) {
+    // Counting sort into hash buckets, so that colliders sharing a cell end up next to each other
+    int buckets = 64;
+    while (buckets < broadphase->cells_size) {
+        buckets *= 2;
+    }
+    if (buckets > broadphase->buckets_capacity) {
+        broadphase->buckets_capacity = buckets;
+        broadphase->buckets = realloc(broadphase->buckets, sizeof(int) * (buckets + 1));
+    }
+
+    int* starts = broadphase->buckets;
+    for (int i = 0; i <= buckets; i++) {
+        starts[i] = 0;
+    }
+    for (int i = 0; i < broadphase->cells_size; i++) {
+        starts[(hash_cell(broadphase->cells[i]) & (buckets - 1)) + 1]++;
+    }
+    for (int i = 0; i < buckets; i++) {
+        starts[i + 1] += starts[i];
+    }
+    for (int i = 0; i < broadphase->cells_size; i++) {
+        GridCell cell = broadphase->cells[i];
+        broadphase->sorted_cells[starts[hash_cell(cell) & (buckets - 1)]++] = cell;
+    }
+    return buckets;
+}
+
+
+static void hash_grid(Broadphase* broadphase) {
+    ComponentArray* proxies = broadphase->proxies;
+
+    // Large colliders like planes would fill too many cells, they are kept aside in the active list
+    broadphase->cells_size = 0;
+    int large_size = 0;
+    for (int k = 0; k < proxies->size; k++) {
+        Proxy* proxy = ComponentArray_at(proxies, k);
+        int min[3], max[3];
+        if (!cell_range(broadphase, proxy, min, max)) {
+            if (large_size == broadphase->active_capacity) {
+                broadphase->active_capacity *= 2;
+                broadphase->active = realloc(broadphase->active, sizeof(Proxy*) * broadphase->active_capacity);
+            }
+            broadphase->active[large_size] = proxy;
+            large_size++;
+            continue;
+        }
+        for (int x = min[0]; x <= max[0]; x++) {
+            for (int y = min[1]; y <= max[1]; y++) {
+                for (int z = min[2]; z <= max[2]; z++) {
+                    add_cell(broadphase, x, y, z, k);
+                }
+            }
+        }
+    }
+
+    unsigned int mask = sort_cells(broadphase) - 1;
+
+    // After sorting every bucket ends where the next one started
+    GridCell* cells = broadphase->sorted_cells;
+    int start = 0;
+    while (start < broadphase->cells_size) {
+        unsigned int bucket = hash_cell(cells[start]) & mask;
+        int end = start + 1;
+        while (end < broadphase->cells_size
+                && (hash_cell(cells[end]) & mask) == bucket) {
+            end++;
+        }
+
+        for (int i = start; i < end; i++) {
+            Proxy* proxy = ComponentArray_at(proxies, cells[i].proxy);
+            for (int j = i + 1; j < end; j++) {
+                if (cells[i].x != cells[j].x || cells[i].y != cells[j].y || cells[i].z != cells[j].z) {
+                    continue;
+                }
+                Proxy* other = ComponentArray_at(proxies, cells[j].proxy);
+                if (!can_collide(proxy, other)) {
+                    continue;
+                }
+
+                // Colliders can share several cells, report the pair only from the first of them
+                int min[3], max[3], other_min[3], other_max[3];
+                cell_range(broadphase, proxy, min, max);
+                cell_range(broadphase, other, other_min, other_max);
+                if (cells[i].x == maxi(min[0], other_min[0]) && cells[i].y == maxi(min[1], other_min[1])
+                        && cells[i].z == maxi(min[2], other_min[2])) {
+                    add_pair(broadphase, proxy->entity, other->entity);
+                }
+            }
+        }
+        start = end;
+    }
+
+    for (int i = 0; i < large_size; i++) {
+        Proxy* proxy = broadphase->active[i];
+        for (int k = 0; k < proxies->size; k++) {
+            Proxy* other = ComponentArray_at(proxies, k);
+            if (other == proxy) {
+                continue;
+            }
+            // Pairs of two large colliders are found twice, keep the one from the earlier proxy
+            int min[3], max[3];
+            if (!cell_range(broadphase, other, min, max) && other < proxy) {
+                continue;
+            }
+            if (can_collide(proxy, other)) {
+                add_pair(broadphase, proxy->entity, other->entity);
+            }
+        }
+    }
+}
+
+
+static bool add_tree_pair(void* data, Entity entity) {
+    TreeQuery* query = data;
+    Proxy* proxy = query->proxy;
+
+    // Both colliders find each other, keep the pair only from the lower handle
+    if (entity <= proxy->entity) {
+        return true;
+    }
+
+    Proxy* other = ComponentArray_get(query->broadphase->proxies, entity);
+    if (can_collide(proxy, other)) {
+        add_pair(query->broadphase, proxy->entity, entity);
+    }
+    return true;
+}
+
+
+static void query_tree(Broadphase* broadphase) {
+    for (int k = 0; k < broadphase->proxies->size; k++) {
+        TreeQuery query = {
+            .broadphase = broadphase,
+            .proxy = ComponentArray_at(broadphase->proxies, k)
+        };
+        AABBTree_query(broadphase->tree, query.proxy->min, query.proxy->max, add_tree_pair, &query);
+    }
+}
+
+
+static bool add_static_pair(void* data, Entity entity) {
+    TreeQuery* query = data;
+    Proxy* other = ComponentArray_get(query->broadphase->static_proxies, entity);
+    if (can_collide(query->proxy, other)) {
+        add_pair(query->broadphase, query->proxy->entity, entity);
+    }
+    return true;
+}
+
+
+static void query_static(Broadphase* broadphase) {
+    for (int k = 0; k < broadphase->proxies->size; k++) {
+        TreeQuery query = {
+            .broadphase = broadphase,
+            .proxy = ComponentArray_at(broadphase->proxies, k)
+        };
+        if (query.proxy->body == BODY_DYNAMIC) {
+            AABBTree_query(broadphase->static_tree, query.proxy->min, query.proxy->max, add_static_pair, &query);
+        }
+    }
+}
+
+
+void Broadphase_update(Broadphase* broadphase, ComponentArray* colliders) {
+    update_proxies(broadphase, colliders);
+
+    broadphase->pairs_size = 0;
+    switch (broadphase->type) {
+        case BROADPHASE_SAP:
+            sweep(broadphase);
+            break;
+        case BROADPHASE_TREE:
+            query_tree(broadphase);
+            break;
+        case BROADPHASE_GRID:
+            hash_grid(broadphase);
+            break;
+    }
+    query_static(broadphase);
+}
+
+
+void Broadphase_destroy(Broadphase* broadphase) {
+    ComponentArray_destroy(broadphase->proxies);
+    AABBTree_destroy(broadphase->tree);
+    ComponentArray_destroy(broadphase->static_proxies);
+    AABBTree_destroy(broadphase->static_tree);
+    free(broadphase->endpoints);
+    free(broadphase->active);
+    free(broadphase->cells);
+    free(broadphase->sorted_cells);
+    free(broadphase->buckets);
+    free(broadphase->pairs);
+    free(broadphase);
+}
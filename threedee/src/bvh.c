@@ -0,0 +1,287 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bvh.h"
+#include "linalg.h"
+
+
+typedef struct {
+    Vector3 centroid;
+    int triangle;
+} BuildEntry;
+
+
+typedef struct {
+    BVH* bvh;
+    BuildEntry* entries;
+    int* indices;  // Triangles of the mesh in their original order
+} BuildState;
+
+
+static Vector3 min3(Vector3 a, Vector3 b) {
+    return (Vector3) { fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z) };
+}
+
+
+static Vector3 max3(Vector3 a, Vector3 b) {
+    return (Vector3) { fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z) };
+}
+
+
+static bool overlaps(BVHNode* node, Vector3 min, Vector3 max) {
+    return node->min.x <= max.x && min.x <= node->max.x
+        && node->min.y <= max.y && min.y <= node->max.y
+        && node->min.z <= max.z && min.z <= node->max.z;
+}
+
+
+static float ray_entry(BVHNode* node, Vector3 origin, Vector3 direction, float max_distance) {
+    // Distance at which the ray enters the bounds of the node, INFINITY if it misses them
+    float t_enter = 0.0f;
+    float t_exit = max_distance;
+    float origins[3] = { origin.x, origin.y, origin.z };
+    float directions[3] = { direction.x, direction.y, direction.z };
+    float mins[3] = { node->min.x, node->min.y, node->min.z };
+    float maxs[3] = { node->max.x, node->max.y, node->max.z };
+    for (int k = 0; k < 3; k++) {
+        if (fabsf(directions[k]) < 1e-12f) {
+            if (origins[k] < mins[k] || origins[k] > maxs[k]) return INFINITY;
+            continue;
+        }
+        float t0 = (mins[k] - origins[k]) / directions[k];
+        float t1 = (maxs[k] - origins[k]) / directions[k];
+        t_enter = fmaxf(t_enter, fminf(t0, t1));
+        t_exit = fminf(t_exit, fmaxf(t0, t1));
+    }
+    return t_enter <= t_exit ? t_enter : INFINITY;
+}
+
+
+static int compare_x(const void* a, const void* b) {
+    float d = ((const BuildEntry*) a)->centroid.x - ((const BuildEntry*) b)->centroid.x;
+    return (d > 0.0f) - (d < 0.0f);
+}
+
+
+static int compare_y(const void* a, const void* b) {
+    float d = ((const BuildEntry*) a)->centroid.y - ((const BuildEntry*) b)->centroid.y;
+    return (d > 0.0f) - (d < 0.0f);
+}
+
+
+static int compare_z(const void* a, const void* b) {
+    float d = ((const BuildEntry*) a)->centroid.z - ((const BuildEntry*) b)->centroid.z;
+    return (d > 0.0f) - (d < 0.0f);
+}
+
+
+static int build_node(BuildState* state, int start, int end) {
+    BVH* bvh = state->bvh;
+    int index = bvh->nodes_size++;
+
+    Vector3 min = vec3(INFINITY, INFINITY, INFINITY);
+    Vector3 max = vec3(-INFINITY, -INFINITY, -INFINITY);
+    Vector3 centroid_min = min;
+    Vector3 centroid_max = max;
+    for (int i = start; i < end; i++) {
+        int* triangle = &state->indices[3 * state->entries[i].triangle];
+        for (int k = 0; k < 3; k++) {
+            min = min3(min, bvh->vertices[triangle[k]]);
+            max = max3(max, bvh->vertices[triangle[k]]);
+        }
+        centroid_min = min3(centroid_min, state->entries[i].centroid);
+        centroid_max = max3(centroid_max, state->entries[i].centroid);
+    }
+
+    bvh->nodes[index] = (BVHNode) {
+        .min = min,
+        .max = max,
+        .first = start,
+        .count = end - start
+    };
+
+    if (end - start <= BVH_LEAF_SIZE) {
+        return index;
+    }
+
+    Vector3 extent = diff3(centroid_max, centroid_min);
+    int (*compare)(const void*, const void*) = compare_x;
+    if (extent.y > extent.x && extent.y >= extent.z) {
+        compare = compare_y;
+    } else if (extent.z > extent.x && extent.z > extent.y) {
+        compare = compare_z;
+    }
+    qsort(&state->entries[start], end - start, sizeof(BuildEntry), compare);
+
+    int middle = start + (end - start) / 2;
+    build_node(state, start, middle);
+    bvh->nodes[index].first = build_node(state, middle, end);
+    bvh->nodes[index].count = 0;
+
+    return index;
+}
+
+
+BVH* BVH_create(Vector3* vertices, int vertices_size, int* indices, int indices_size) {
+    BVH* bvh = malloc(sizeof(BVH));
+    bvh->vertices_size = vertices_size > 0 ? vertices_size : 0;
+    bvh->vertices = malloc(sizeof(Vector3) * (size_t) (bvh->vertices_size > 0 ? bvh->vertices_size : 1));
+    memcpy(bvh->vertices, vertices, sizeof(Vector3) * (size_t) bvh->vertices_size);
+    bvh->triangles_size = indices_size > 0 ? indices_size / 3 : 0;
+    bvh->indices = malloc(sizeof(int) * (size_t) (bvh->triangles_size > 0 ? 3 * bvh->triangles_size : 1));
+    // A binary tree with a leaf per triangle at most has this many nodes
+    bvh->nodes = malloc(sizeof(BVHNode) * (size_t) (bvh->triangles_size > 0 ? 2 * bvh->triangles_size : 1));
+    bvh->nodes_size = 0;
+
+    if (bvh->triangles_size <= 0) {
+        LOG_WARNING("Building BVH of a mesh without triangles");
+        return bvh;
+    }
+
+    BuildEntry* entries = malloc(sizeof(BuildEntry) * (size_t) bvh->triangles_size);
+    for (int i = 0; i < bvh->triangles_size; i++) {
+        Vector3 a = vertices[indices[3 * i]];
+        Vector3 b = vertices[indices[3 * i + 1]];
+        Vector3 c = vertices[indices[3 * i + 2]];
+        entries[i] = (BuildEntry) {
+            .centroid = mult3(1.0f / 3.0f, sum3(sum3(a, b), c)),
+            .triangle = i
+        };
+    }
+
+    BuildState state = {
+        .bvh = bvh,
+        .entries = entries,
+        .indices = indices
+    };
+    build_node(&state, 0, bvh->triangles_size);
+
+    // Store the triangles in leaf order so that each leaf refers to a contiguous range
+    for (int i = 0; i < bvh->triangles_size; i++) {
+        memcpy(&bvh->indices[3 * i], &indices[3 * entries[i].triangle], sizeof(int) * 3);
+    }
+    free(entries);
+
+    bvh->nodes = realloc(bvh->nodes, sizeof(BVHNode) * (size_t) bvh->nodes_size);
+
+    return bvh;
+}
+
+
+Triangle BVH_triangle(BVH* bvh, int triangle) {
+    int* indices = &bvh->indices[3 * triangle];
+    return (Triangle) {
+        .a = bvh->vertices[indices[0]],
+        .b = bvh->vertices[indices[1]],
+        .c = bvh->vertices[indices[2]]
+    };
+}
+
+
+void BVH_bounds(BVH* bvh, Vector3* min, Vector3* max) {
+    if (bvh->nodes_size == 0) {
+        *min = zeros3();
+        *max = zeros3();
+        return;
+    }
+    *min = bvh->nodes[0].min;
+    *max = bvh->nodes[0].max;
+}
+
+
+void BVH_query(BVH* bvh, Vector3 min, Vector3 max, BVHQueryCallback callback, void* data) {
+    // Median splits keep the depth logarithmic, so a fixed stack is enough
+    int stack[64];
+    int stack_size = 0;
+
+    if (bvh->nodes_size > 0) {
+        stack[stack_size++] = 0;
+    }
+
+    while (stack_size > 0) {
+        int index = stack[--stack_size];
+        BVHNode* node = &bvh->nodes[index];
+        if (!overlaps(node, min, max)) continue;
+
+        if (node->count > 0) {
+            for (int i = node->first; i < node->first + node->count; i++) {
+                if (!callback(data, i)) {
+                    return;
+                }
+            }
+        } else {
+            stack[stack_size++] = node->first;
+            stack[stack_size++] = index + 1;
+        }
+    }
+}
+
+
+float BVH_raycast(BVH* bvh, Vector3 origin, Vector3 direction, float max_distance, Vector3* normal) {
+    // The nearer child is visited first, and nodes entered beyond the closest hit so far are skipped
+    int stack[64];
+    float entries[64];
+    int stack_size = 0;
+
+    if (bvh->nodes_size > 0) {
+        stack[stack_size] = 0;
+        entries[stack_size++] = ray_entry(&bvh->nodes[0], origin, direction, max_distance);
+    }
+
+    float distance = max_distance;
+    int hit = -1;
+    while (stack_size > 0) {
+        stack_size--;
+        int index = stack[stack_size];
+        if (entries[stack_size] >= distance) continue;
+
+        BVHNode* node = &bvh->nodes[index];
+        if (node->count > 0) {
+            for (int i = node->first; i < node->first + node->count; i++) {
+                float t = ray_triangle_distance(BVH_triangle(bvh, i), origin, direction);
+                if (t < distance) {
+                    distance = t;
+                    hit = i;
+                }
+            }
+        } else {
+            int near = index + 1;
+            int far = node->first;
+            float near_entry = ray_entry(&bvh->nodes[near], origin, direction, distance);
+            float far_entry = ray_entry(&bvh->nodes[far], origin, direction, distance);
+            if (far_entry < near_entry) {
+                int swap = near;
+                near = far;
+                far = swap;
+                float swap_entry = near_entry;
+                near_entry = far_entry;
+                far_entry = swap_entry;
+            }
+            stack[stack_size] = far;
+            entries[stack_size++] = far_entry;
+            stack[stack_size] = near;
+            entries[stack_size++] = near_entry;
+        }
+    }
+
+    if (hit == -1) {
+        return INFINITY;
+    }
+
+    Triangle triangle = BVH_triangle(bvh, hit);
+    *normal = normalized3(cross(diff3(triangle.b, triangle.a), diff3(triangle.c, triangle.a)));
+    if (dot3(*normal, direction) > 0.0f) {
+        *normal = neg3(*normal);
+    }
+    return distance;
+}
+
+
+void BVH_destroy(BVH* bvh) {
+    free(bvh->vertices);
+    free(bvh->indices);
+    free(bvh->nodes);
+    free(bvh);
+}
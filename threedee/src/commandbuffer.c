@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "commandbuffer.h"
+#include "scene.h"
+#include "util.h"
+
+
+// Placeholders count down from below NULL_ENTITY so they never collide with real handles
+#define PLACEHOLDER(index) (-2 - (index))
+#define PLACEHOLDER_INDEX(entity) (-2 - (entity))
+
+
+CommandBuffer* CommandBuffer_create() {
+    CommandBuffer* buffer = malloc(sizeof(CommandBuffer));
+    buffer->capacity = 64;
+    buffer->commands = malloc(sizeof(Command) * buffer->capacity);
+    buffer->size = 0;
+    buffer->data_capacity = 1024;
+    buffer->data = malloc(buffer->data_capacity);
+    buffer->data_size = 0;
+    buffer->created = 0;
+    return buffer;
+}
+
+
+static void push_command(CommandBuffer* buffer, Command command) {
+    if (buffer->size >= buffer->capacity) {
+        buffer->capacity *= 2;
+        buffer->commands = realloc(buffer->commands, sizeof(Command) * buffer->capacity);
+    }
+    buffer->commands[buffer->size] = command;
+    buffer->size++;
+}
+
+
+static int push_data(CommandBuffer* buffer, void* data, int size) {
+    // Keep every parameter block aligned for any field type
+    int offset = (buffer->data_size + 15) & ~15;
+    while (offset + size > buffer->data_capacity) {
+        buffer->data_capacity *= 2;
+        buffer->data = realloc(buffer->data, buffer->data_capacity);
+    }
+    memcpy(buffer->data + offset, data, size);
+    buffer->data_size = offset + size;
+    return offset;
+}
+
+
+Entity CommandBuffer_create_entity(CommandBuffer* buffer) {
+    Entity entity = PLACEHOLDER(buffer->created);
+    buffer->created++;
+    push_command(buffer, (Command) {
+        .type = COMMAND_CREATE,
+        .entity = entity,
+        .parameters = -1
+    });
+    return entity;
+}
+
+
+void CommandBuffer_destroy_entity(CommandBuffer* buffer, Entity entity) {
+    push_command(buffer, (Command) {
+        .type = COMMAND_DESTROY,
+        .entity = entity,
+        .parameters = -1
+    });
+}
+
+
+void CommandBuffer_add_component(CommandBuffer* buffer, Entity entity, ComponentType component_type,
+        ComponentConstructor constructor, void* parameters, int parameters_size) {
+    push_command(buffer, (Command) {
+        .type = COMMAND_ADD_COMPONENT,
+        .entity = entity,
+        .component_type = component_type,
+        .constructor = constructor,
+        .parameters = parameters ? push_data(buffer, parameters, parameters_size) : -1
+    });
+}
+
+
+void CommandBuffer_remove_component(CommandBuffer* buffer, Entity entity, ComponentType component_type) {
+    push_command(buffer, (Command) {
+        .type = COMMAND_REMOVE_COMPONENT,
+        .entity = entity,
+        .component_type = component_type,
+        .parameters = -1
+    });
+}
+
+
+static Entity resolve(Entity* created, int created_size, Entity entity) {
+    if (entity < NULL_ENTITY) {
+        int index = PLACEHOLDER_INDEX(entity);
+        return index < created_size ? created[index] : NULL_ENTITY;
+    }
+    return entity;
+}
+
+
+void CommandBuffer_execute(CommandBuffer* buffer) {
+    if (buffer->size == 0) {
+        return;
+    }
+
+    // Size storage for the whole batch first so that playback does not grow arrays one by one
+    int adds[COMPONENT_COUNT] = { 0 };
+    for (int i = 0; i < buffer->size; i++) {
+        if (buffer->commands[i].type == COMMAND_ADD_COMPONENT) {
+            adds[buffer->commands[i].component_type]++;
+        }
+    }
+    reserve_entities(scene->components->alive_entities + buffer->created);
+    for (ComponentType type = 0; type < COMPONENT_COUNT; type++) {
+        if (adds[type] > 0) {
+            reserve_components(type, get_component_array(type)->size + adds[type]);
+        }
+    }
+
+    Entity* created = malloc(sizeof(Entity) * (buffer->created + 1));
+    int created_size = 0;
+
+    for (int i = 0; i < buffer->size; i++) {
+        Command* command = &buffer->commands[i];
+
+        if (command->type == COMMAND_CREATE) {
+            created[created_size] = create_entity();
+            created_size++;
+            continue;
+        }
+
+        Entity entity = resolve(created, created_size, command->entity);
+        if (!entity_exists(entity)) {
+            // Destroyed earlier in the batch or by someone else since recording
+            continue;
+        }
+
+        switch (command->type) {
+            case COMMAND_DESTROY:
+                destroy_entity(entity);
+                break;
+            case COMMAND_ADD_COMPONENT:
+                if (command->constructor) {
+                    command->constructor(entity, command->parameters == -1 ? NULL : buffer->data + command->parameters);
+                } else {
+                    add_component(entity, command->component_type);
+                }
+                break;
+            case COMMAND_REMOVE_COMPONENT:
+                remove_component(entity, command->component_type);
+                break;
+            default:
+                break;
+        }
+    }
+
+    free(created);
+    CommandBuffer_clear(buffer);
+}
+
+
+void CommandBuffer_clear(CommandBuffer* buffer) {
+    buffer->size = 0;
+    buffer->data_size = 0;
+    buffer->created = 0;
+}
+
+
+void CommandBuffer_destroy(CommandBuffer* buffer) {
+    free(buffer->commands);
+    free(buffer->data);
+    free(buffer);
+}
@@ -11,87 +11,133 @@
 #include "components/light.h"
 #include "components/rigidbody.h"
 #include "components/transform.h"
+#include "threadpool.h"
+
+#define TRANSFORM_BATCH_SIZE 1024
 
 
 ComponentData* ComponentData_create() {
     ComponentData* components = malloc(sizeof(ComponentData));
-    memset(components, 0, sizeof(ComponentData));
+    components->entities = 0;
+    components->alive_entities = 0;
+    components->slots_capacity = 64;
+    components->slots = malloc(sizeof(EntitySlot) * components->slots_capacity);
+    components->free_slot = -1;
+    components->queries_size = 0;
+    components->hierarchy = (Hierarchy) {
+        .order = NULL,
+        .parents = NULL,
+        .level_offsets = NULL,
+        .levels = 0,
+        .size = 0,
+        .capacity = 0,
+        .dirty = true
+    };
+    components->transform = ComponentArray_create(sizeof(TransformComponent));
+    components->camera = ComponentArray_create(sizeof(CameraComponent));
+    components->sound = ComponentArray_create(sizeof(SoundComponent));
+    components->mesh = ComponentArray_create(sizeof(MeshComponent));
+    components->light = ComponentArray_create(sizeof(LightComponent));
+    components->rigid_body = ComponentArray_create(sizeof(RigidBodyComponent));
+    components->collider = ComponentArray_create(sizeof(ColliderComponent));
+    components->controller = ComponentArray_create(sizeof(ControllerComponent));
+    components->weather = ComponentArray_create(sizeof(WeatherComponent));
+    components->player = ComponentArray_create(sizeof(PlayerComponent));
+    for (ComponentType type = 0; type < COMPONENT_COUNT; type++) {
+        components->changes[type].added = ComponentArray_create(0);
+        components->changes[type].removed = ComponentArray_create(0);
+        components->changes[type].modified = ComponentArray_create(0);
+    }
     return components;
 }
 
 
 SoundComponent* SoundComponent_add(Entity entity, Filename hit_sound) {
-    SoundComponent* sound = malloc(sizeof(SoundComponent));
+    SoundComponent* sound = add_component(entity, COMPONENT_SOUND);
     sound->size = 4;
     for (int i = 0; i < sound->size; i++) {
         sound->events[i] = NULL;
     }
     strcpy(sound->hit_sound, hit_sound);
     strcpy(sound->loop_sound, "");
-    scene->components->sound[entity] = sound;
     return sound;
 }
 
 
 SoundComponent* SoundComponent_get(Entity entity) {
     if (entity == -1) return NULL;
-    return scene->components->sound[entity];
+    return ComponentArray_get(scene->components->sound, entity);
 }
 
 
 void SoundComponent_remove(Entity entity) {
-    SoundComponent* sound = SoundComponent_get(entity);
-    if (sound) {
-        free(sound);
-        scene->components->sound[entity] = NULL;
+    release_component(entity, COMPONENT_SOUND);
+}
+
+
+void reserve_entities(int count) {
+    ComponentData* components = scene->components;
+    if (count > MAX_ENTITIES) {
+        count = MAX_ENTITIES;
+    }
+    if (count > components->slots_capacity) {
+        components->slots_capacity = count;
+        components->slots = realloc(components->slots, sizeof(EntitySlot) * components->slots_capacity);
     }
 }
 
 
 Entity create_entity() {
-    for (Entity i = 0; i < scene->components->entities; i++) {
-        if (!scene->components->transform[i]) {
-            if (scene->components->added_entities) {
-                List_add(scene->components->added_entities, i);
-            }
-            return i;
+    ComponentData* components = scene->components;
+
+    int index = components->free_slot;
+    if (index != -1) {
+        components->free_slot = components->slots[index].next_free;
+    } else {
+        if (components->entities >= MAX_ENTITIES) {
+            LOG_ERROR("Too many entities: %d", components->entities);
+            return NULL_ENTITY;
+        }
+        if (components->entities >= components->slots_capacity) {
+            components->slots_capacity *= 2;
+            components->slots = realloc(components->slots, sizeof(EntitySlot) * components->slots_capacity);
         }
+        index = components->entities;
+        components->entities++;
+        components->slots[index].generation = 0;
     }
 
-    scene->components->entities++;
-    if (scene->components->added_entities) {
-        List_add(scene->components->added_entities, scene->components->entities - 1);
-    }
-    return scene->components->entities - 1;
+    EntitySlot* slot = &components->slots[index];
+    slot->next_free = ENTITY_ALIVE;
+    slot->mask = 0;
+    components->alive_entities++;
+
+    return ENTITY_HANDLE(index, slot->generation);
 }
 
 
-void* get_component(Entity entity, ComponentType component_type) {
-    if (entity == NULL_ENTITY) {
-        return NULL;
-    }
-
+ComponentArray* get_component_array(ComponentType component_type) {
     switch (component_type) {
         case COMPONENT_TRANSFORM:
-            return scene->components->transform[entity];
+            return scene->components->transform;
         case COMPONENT_CAMERA:
-            return scene->components->camera[entity];
+            return scene->components->camera;
         case COMPONENT_SOUND:
-            return SoundComponent_get(entity);
+            return scene->components->sound;
         case COMPONENT_MESH:
-            return scene->components->mesh[entity];
+            return scene->components->mesh;
         case COMPONENT_LIGHT:
-            return scene->components->light[entity];
+            return scene->components->light;
         case COMPONENT_RIGIDBODY:
-            return scene->components->rigid_body[entity];
+            return scene->components->rigid_body;
         case COMPONENT_COLLIDER:
-            return scene->components->collider[entity];
+            return scene->components->collider;
         case COMPONENT_CONTROLLER:
-            return scene->components->controller[entity];
+            return scene->components->controller;
         case COMPONENT_WEATHER:
-            return scene->components->weather[entity];
+            return scene->components->weather;
         case COMPONENT_PLAYER:
-            return scene->components->player[entity];
+            return scene->components->player;
         default:
             LOG_ERROR("Unknown component type: %d", component_type);
             return NULL;
@@ -99,6 +145,184 @@ void* get_component(Entity entity, ComponentType component_type) {
 }
 
 
+void reserve_components(ComponentType component_type, int count) {
+    // Preallocate storage before a burst of spawns so that no reallocation happens mid-frame
+    ComponentArray* array = get_component_array(component_type);
+    if (array) {
+        ComponentArray_reserve(array, count);
+    }
+}
+
+
+void print_component_stats() {
+    static const char* names[COMPONENT_COUNT] = {
+        "Transform", "Camera", "Sound", "Mesh", "Light", "RigidBody", "Collider", "Controller", "Weather", "Player"
+    };
+
+    LOG_INFO("Entities: %d alive, %d slots", scene->components->alive_entities, scene->components->entities);
+    for (ComponentType type = 0; type < COMPONENT_COUNT; type++) {
+        ComponentArray* array = get_component_array(type);
+        LOG_INFO("%s: %d/%d in use, peak %d, %d grows",
+            names[type], array->size, array->capacity, array->peak, array->grows);
+    }
+    Pool_print_stats(ComponentArray_page_pool(), "Index pages");
+    LOG_INFO("Contact events: %d/%d", scene->contacts->events_size, scene->contacts->events_capacity);
+}
+
+
+void update_queries(Entity entity, unsigned int old_mask, unsigned int new_mask) {
+    ComponentData* components = scene->components;
+    for (int i = 0; i < components->queries_size; i++) {
+        Query* query = &components->queries[i];
+        bool was_match = (old_mask & query->mask) == query->mask;
+        bool is_match = (new_mask & query->mask) == query->mask;
+        if (is_match && !was_match) {
+            ComponentArray_add(query->matches, entity);
+        } else if (was_match && !is_match) {
+            ComponentArray_remove(query->matches, entity);
+        }
+    }
+}
+
+
+static void mark_shape_dirty(Entity entity, ComponentType component_type) {
+    // Cached collider shapes follow this flag rather than the journal, which is cleared every frame
+    if (component_type == COMPONENT_TRANSFORM || component_type == COMPONENT_COLLIDER) {
+        ColliderComponent* collider = get_component(entity, COMPONENT_COLLIDER);
+        if (collider) {
+            collider->shape_dirty = true;
+        }
+    }
+}
+
+
+void* add_component(Entity entity, ComponentType component_type) {
+    ComponentArray* array = get_component_array(component_type);
+    if (!array) {
+        return NULL;
+    }
+    if (!entity_exists(entity)) {
+        LOG_ERROR("Adding component %d to nonexistent entity %d", component_type, entity);
+        return NULL;
+    }
+
+    void* component = ComponentArray_get(array, entity);
+    if (component) {
+        return component;
+    }
+    component = ComponentArray_add(array, entity);
+
+    EntitySlot* slot = &scene->components->slots[ENTITY_INDEX(entity)];
+    unsigned int old_mask = slot->mask;
+    slot->mask |= COMPONENT_MASK(component_type);
+    update_queries(entity, old_mask, slot->mask);
+
+    ComponentArray_add(scene->components->changes[component_type].added, entity);
+    mark_shape_dirty(entity, component_type);
+
+    return component;
+}
+
+
+void release_component(Entity entity, ComponentType component_type) {
+    // Called by the *_remove functions once the component has released its own resources
+    ComponentArray* array = get_component_array(component_type);
+    if (!array || !ComponentArray_has(array, entity)) {
+        return;
+    }
+    ComponentArray_remove(array, entity);
+
+    EntitySlot* slot = &scene->components->slots[ENTITY_INDEX(entity)];
+    unsigned int old_mask = slot->mask;
+    slot->mask &= ~COMPONENT_MASK(component_type);
+    update_queries(entity, old_mask, slot->mask);
+
+    ComponentChanges* changes = &scene->components->changes[component_type];
+    ComponentArray_remove(changes->modified, entity);
+    if (ComponentArray_has(changes->added, entity)) {
+        ComponentArray_remove(changes->added, entity);
+    } else {
+        ComponentArray_add(changes->removed, entity);
+    }
+}
+
+
+void mark_modified(Entity entity, ComponentType component_type) {
+    mark_shape_dirty(entity, component_type);
+    ComponentChanges* changes = &scene->components->changes[component_type];
+    if (!ComponentArray_has(changes->added, entity)) {
+        ComponentArray_add(changes->modified, entity);
+    }
+}
+
+
+ComponentChanges* get_changes(ComponentType component_type) {
+    return &scene->components->changes[component_type];
+}
+
+
+void clear_changes() {
+    // Called once per frame after the systems reading the journal, command playback and draw
+    // happen afterwards so that their changes reach the next tick
+    for (ComponentType type = 0; type < COMPONENT_COUNT; type++) {
+        ComponentArray_clear(scene->components->changes[type].added);
+        ComponentArray_clear(scene->components->changes[type].removed);
+        ComponentArray_clear(scene->components->changes[type].modified);
+    }
+}
+
+
+bool has_components(Entity entity, unsigned int mask) {
+    if (!entity_exists(entity)) {
+        return false;
+    }
+    return (scene->components->slots[ENTITY_INDEX(entity)].mask & mask) == mask;
+}
+
+
+ComponentArray* query_entities(unsigned int mask) {
+    // Queries are created on first use and kept up to date as components are added and removed
+    ComponentData* components = scene->components;
+    for (int i = 0; i < components->queries_size; i++) {
+        if (components->queries[i].mask == mask) {
+            return components->queries[i].matches;
+        }
+    }
+
+    if (components->queries_size >= MAX_QUERIES) {
+        LOG_ERROR("Too many queries: %d", components->queries_size);
+        return NULL;
+    }
+
+    Query* query = &components->queries[components->queries_size];
+    components->queries_size++;
+    query->mask = mask;
+    query->matches = ComponentArray_create(0);
+
+    for (int i = 0; i < components->entities; i++) {
+        EntitySlot* slot = &components->slots[i];
+        if (slot->next_free == ENTITY_ALIVE && (slot->mask & mask) == mask) {
+            ComponentArray_add(query->matches, ENTITY_HANDLE(i, slot->generation));
+        }
+    }
+
+    return query->matches;
+}
+
+
+void* get_component(Entity entity, ComponentType component_type) {
+    if (entity == NULL_ENTITY) {
+        return NULL;
+    }
+
+    ComponentArray* array = get_component_array(component_type);
+    if (!array) {
+        return NULL;
+    }
+    return ComponentArray_get(array, entity);
+}
+
+
 void remove_component(Entity entity, ComponentType component_type) {
     switch (component_type) {
         case COMPONENT_TRANSFORM:
@@ -118,12 +342,19 @@ void remove_component(Entity entity, ComponentType component_type) {
             break;
         case COMPONENT_RIGIDBODY:
             RigidBodyComponent_remove(entity);
+            break;
         case COMPONENT_COLLIDER:
             ColliderComponent_remove(entity);
             break;
         case COMPONENT_CONTROLLER:
             ControllerComponent_remove(entity);
             break;
+        case COMPONENT_WEATHER:
+            WeatherComponent_remove(entity);
+            break;
+        case COMPONENT_PLAYER:
+            PlayerComponent_remove(entity);
+            break;
         default:
             LOG_ERROR("Unknown component type: %d", component_type);
             break;
@@ -133,28 +364,56 @@ void remove_component(Entity entity, ComponentType component_type) {
 
 Entity get_root(Entity entity) {
     TransformComponent* coord = get_component(entity, COMPONENT_TRANSFORM);
-    if (coord->parent != -1) {
-        return get_root(coord->parent);
+    while (coord->parent != NULL_ENTITY) {
+        entity = coord->parent;
+        coord = get_component(entity, COMPONENT_TRANSFORM);
     }
     return entity;
 }
 
 
 void add_child(Entity parent, Entity child) {
+    remove_parent(child);
+
     TransformComponent* trans = get_component(child, COMPONENT_TRANSFORM);
-    trans->parent = parent;
     TransformComponent* parent_trans = get_component(parent, COMPONENT_TRANSFORM);
-    List_append(parent_trans->children, child);
+    trans->parent = parent;
+    trans->next_sibling = NULL_ENTITY;
+    trans->prev_sibling = NULL_ENTITY;
+
+    // Append to keep children in insertion order
+    if (parent_trans->first_child == NULL_ENTITY) {
+        parent_trans->first_child = child;
+    } else {
+        Entity last = parent_trans->first_child;
+        TransformComponent* last_trans = get_component(last, COMPONENT_TRANSFORM);
+        while (last_trans->next_sibling != NULL_ENTITY) {
+            last = last_trans->next_sibling;
+            last_trans = get_component(last, COMPONENT_TRANSFORM);
+        }
+        last_trans->next_sibling = child;
+        trans->prev_sibling = last;
+    }
+
+    scene->components->hierarchy.dirty = true;
+    mark_transform_dirty(child);
 }
 
 
 void remove_children(Entity parent) {
     TransformComponent* trans = get_component(parent, COMPONENT_TRANSFORM);
-    for (ListNode* node = trans->children->head; node; node = node->next) {
-        TransformComponent* child_trans = get_component(node->value, COMPONENT_TRANSFORM);
+    Entity child = trans->first_child;
+    while (child != NULL_ENTITY) {
+        TransformComponent* child_trans = get_component(child, COMPONENT_TRANSFORM);
+        Entity next = child_trans->next_sibling;
         child_trans->parent = NULL_ENTITY;
+        child_trans->next_sibling = NULL_ENTITY;
+        child_trans->prev_sibling = NULL_ENTITY;
+        mark_transform_dirty(child);
+        child = next;
     }
-    List_clear(trans->children);
+    trans->first_child = NULL_ENTITY;
+    scene->components->hierarchy.dirty = true;
 }
 
 
@@ -162,12 +421,43 @@ void remove_parent(Entity child) {
     TransformComponent* trans = get_component(child, COMPONENT_TRANSFORM);
     if (trans->parent != NULL_ENTITY) {
         TransformComponent* parent = get_component(trans->parent, COMPONENT_TRANSFORM);
-        List_remove(parent->children, child);
+        if (trans->prev_sibling != NULL_ENTITY) {
+            TransformComponent* prev = get_component(trans->prev_sibling, COMPONENT_TRANSFORM);
+            prev->next_sibling = trans->next_sibling;
+        } else {
+            parent->first_child = trans->next_sibling;
+        }
+        if (trans->next_sibling != NULL_ENTITY) {
+            TransformComponent* next = get_component(trans->next_sibling, COMPONENT_TRANSFORM);
+            next->prev_sibling = trans->prev_sibling;
+        }
         trans->parent = NULL_ENTITY;
+        trans->next_sibling = NULL_ENTITY;
+        trans->prev_sibling = NULL_ENTITY;
+        scene->components->hierarchy.dirty = true;
+        mark_transform_dirty(child);
     }
 }
 
 
+Entity next_in_subtree(Entity entity, Entity root, bool descend) {
+    // Pre-order successor of entity within the subtree of root, walking the sibling links
+    // without recursion. With descend false the children of entity are skipped.
+    TransformComponent* trans = get_component(entity, COMPONENT_TRANSFORM);
+    if (descend && trans->first_child != NULL_ENTITY) {
+        return trans->first_child;
+    }
+    while (entity != root) {
+        if (trans->next_sibling != NULL_ENTITY) {
+            return trans->next_sibling;
+        }
+        entity = trans->parent;
+        trans = get_component(entity, COMPONENT_TRANSFORM);
+    }
+    return NULL_ENTITY;
+}
+
+
 void remove_prefab(Entity entity) {
     TransformComponent* coord = get_component(entity, COMPONENT_TRANSFORM);
     coord->prefab[0] = '\0';
@@ -175,16 +465,20 @@ void remove_prefab(Entity entity) {
 
 
 void destroy_entity(Entity entity) {
-    if (entity == -1) return;
-
-    // TODO: remove parent
+    if (!entity_exists(entity)) return;
 
-    TransformComponent_remove(entity);
-    CameraComponent_remove(entity);
-
-    if (entity == scene->components->entities - 1) {
-        scene->components->entities--;
+    for (ComponentType type = 0; type < COMPONENT_COUNT; type++) {
+        remove_component(entity, type);
     }
+
+    // Bump the generation so that existing handles to this entity become stale
+    ComponentData* components = scene->components;
+    int index = ENTITY_INDEX(entity);
+    EntitySlot* slot = &components->slots[index];
+    slot->generation = (slot->generation + 1) & ENTITY_GENERATION_MASK;
+    slot->next_free = components->free_slot;
+    components->free_slot = index;
+    components->alive_entities--;
 }
 
 
@@ -196,37 +490,46 @@ void destroy_entities(List* entities) {
 }
 
 
-void do_destroy_entity_recursive(Entity entity) {
-    TransformComponent* coord = get_component(entity, COMPONENT_TRANSFORM);
-    for (ListNode* node = coord->children->head; node; node = node->next) {
-        do_destroy_entity_recursive(node->value);
-    }
-    List_clear(coord->children);
-    destroy_entity(entity);
-}
-
-
 void destroy_entity_recursive(Entity entity) {
     remove_parent(entity);
-    do_destroy_entity_recursive(entity);
+
+    // Destroy in reverse pre-order so that children are always removed before their parents
+    ArrayList* subtree = ArrayList_create(sizeof(Entity));
+    for (Entity node = entity; node != NULL_ENTITY; node = next_in_subtree(node, entity, true)) {
+        ArrayList_add(subtree, &node);
+    }
+    for (int i = subtree->size - 1; i >= 0; i--) {
+        destroy_entity(*(Entity*)ArrayList_get(subtree, i));
+    }
+    ArrayList_destroy(subtree);
 }
 
 
 void ComponentData_clear() {
-    for (int i = 0; i < scene->components->entities; i++) {
-        destroy_entity(i);
+    // Destroying entities while walking the slots would free slots under the loop, so the whole
+    // scene is recorded first and destroyed in one batch
+    ComponentData* components = scene->components;
+    for (int i = 0; i < components->entities; i++) {
+        EntitySlot* slot = &components->slots[i];
+        if (slot->next_free == ENTITY_ALIVE) {
+            CommandBuffer_destroy_entity(scene->commands, ENTITY_HANDLE(i, slot->generation));
+        }
     }
-    scene->components->entities = 0;
+    CommandBuffer_execute(scene->commands);
 }
 
 
 Matrix4 get_transform(Entity entity) {
     TransformComponent* trans = get_component(entity, COMPONENT_TRANSFORM);
-    Matrix4 transform = transform_matrix(trans->position, trans->rotation, trans->scale);
-    if (trans->parent != NULL_ENTITY) {
-        return matrix4_mult(get_transform(trans->parent), transform);
+    if (trans->dirty) {
+        Matrix4 transform = transform_matrix(trans->position, trans->rotation, trans->scale);
+        if (trans->parent != NULL_ENTITY) {
+            transform = matrix4_mult(get_transform(trans->parent), transform);
+        }
+        trans->world = transform;
+        trans->dirty = false;
     }
-    return transform;
+    return trans->world;
 }
 
 
@@ -235,6 +538,137 @@ void set_transform(Entity entity, Matrix4 transform) {
     trans->position = position_from_transform(transform);
     trans->scale = scale_from_transform(transform);
     trans->rotation = rotation_from_transform(transform);
+    mark_transform_dirty(entity);
+}
+
+
+void mark_transform_dirty(Entity entity) {
+    TransformComponent* trans = get_component(entity, COMPONENT_TRANSFORM);
+    if (!trans || trans->dirty) {
+        return;
+    }
+
+    Entity node = entity;
+    while (node != NULL_ENTITY) {
+        TransformComponent* node_trans = get_component(node, COMPONENT_TRANSFORM);
+        // Descendants of a dirty transform are always dirty as well, so its subtree can be skipped
+        bool descend = !node_trans->dirty;
+        node_trans->dirty = true;
+        mark_modified(node, COMPONENT_TRANSFORM);
+        node = next_in_subtree(node, entity, descend);
+    }
+}
+
+
+void rebuild_hierarchy() {
+    ComponentArray* transforms = scene->components->transform;
+    Hierarchy* hierarchy = &scene->components->hierarchy;
+
+    if (hierarchy->capacity < transforms->size + 1) {
+        hierarchy->capacity = transforms->size + 1;
+        hierarchy->order = realloc(hierarchy->order, sizeof(int) * hierarchy->capacity);
+        hierarchy->parents = realloc(hierarchy->parents, sizeof(int) * hierarchy->capacity);
+        hierarchy->level_offsets = realloc(hierarchy->level_offsets, sizeof(int) * (hierarchy->capacity + 1));
+    }
+
+    hierarchy->size = 0;
+    for (int k = 0; k < transforms->size; k++) {
+        TransformComponent* trans = ComponentArray_at(transforms, k);
+        if (trans->parent == NULL_ENTITY) {
+            hierarchy->order[hierarchy->size] = k;
+            hierarchy->parents[hierarchy->size] = -1;
+            hierarchy->size++;
+        }
+    }
+
+    // Breadth-first walk using the order array itself as the queue
+    hierarchy->levels = 0;
+    int start = 0;
+    while (start < hierarchy->size) {
+        int end = hierarchy->size;
+        hierarchy->level_offsets[hierarchy->levels] = start;
+        hierarchy->levels++;
+
+        for (int i = start; i < end; i++) {
+            TransformComponent* trans = ComponentArray_at(transforms, hierarchy->order[i]);
+            for (Entity child = trans->first_child; child != NULL_ENTITY; ) {
+                int slot = ComponentArray_index(transforms, child);
+                hierarchy->order[hierarchy->size] = slot;
+                hierarchy->parents[hierarchy->size] = hierarchy->order[i];
+                hierarchy->size++;
+                child = ((TransformComponent*)ComponentArray_at(transforms, slot))->next_sibling;
+            }
+        }
+
+        start = end;
+    }
+    hierarchy->level_offsets[hierarchy->levels] = hierarchy->size;
+
+    hierarchy->dirty = false;
+}
+
+
+static void update_transform_batch(void* data, int start, int end) {
+    (void) data;
+    update_transform_range(start, end);
+}
+
+
+void update_transform_range(int start, int end) {
+    // Entries within a depth level only read world matrices of the previous level
+    Hierarchy* hierarchy = &scene->components->hierarchy;
+    TransformComponent* transforms = scene->components->transform->data;
+
+    for (int i = start; i < end; i++) {
+        TransformComponent* trans = transforms + hierarchy->order[i];
+        if (!trans->dirty) continue;
+
+        Matrix4 transform = transform_matrix(trans->position, trans->rotation, trans->scale);
+        int parent = hierarchy->parents[i];
+        if (parent != -1) {
+            transform = matrix4_mult(transforms[parent].world, transform);
+        }
+        trans->world = transform;
+        trans->dirty = false;
+    }
+}
+
+
+void update_transforms() {
+    Hierarchy* hierarchy = &scene->components->hierarchy;
+    if (hierarchy->dirty) {
+        rebuild_hierarchy();
+    }
+
+    for (int level = 0; level < hierarchy->levels; level++) {
+        ThreadPool_parallel_for(thread_pool, hierarchy->level_offsets[level], hierarchy->level_offsets[level + 1],
+            TRANSFORM_BATCH_SIZE, update_transform_batch, NULL);
+    }
+}
+
+
+void set_position(Entity entity, Vector3 position) {
+    TransformComponent* trans = get_component(entity, COMPONENT_TRANSFORM);
+    trans->position = position;
+    mark_transform_dirty(entity);
+}
+
+
+void set_rotation(Entity entity, Quaternion rotation) {
+    TransformComponent* trans = get_component(entity, COMPONENT_TRANSFORM);
+    trans->rotation = rotation;
+    mark_transform_dirty(entity);
+}
+
+
+void set_scale(Entity entity, Vector3 scale) {
+    TransformComponent* trans = get_component(entity, COMPONENT_TRANSFORM);
+    trans->scale = scale;
+    mark_transform_dirty(entity);
+    if (get_component(entity, COMPONENT_COLLIDER)) {
+        // Scale changes the world-space shape of the collider
+        mark_modified(entity, COMPONENT_COLLIDER);
+    }
 }
 
 
@@ -298,23 +732,23 @@ Vector3 get_scale(Entity entity) {
 
 
 bool entity_exists(Entity entity) {
-    TransformComponent* coord = get_component(entity, COMPONENT_TRANSFORM);
-    if (coord) {
-        return true;
+    if (entity < 0) {
+        return false;
     }
-    return false;
-}
 
+    int index = ENTITY_INDEX(entity);
+    if (index >= scene->components->entities) {
+        return false;
+    }
 
-int get_parent(Entity entity) {
-    TransformComponent* coord = get_component(entity, COMPONENT_TRANSFORM);
-    return coord->parent;
+    EntitySlot* slot = &scene->components->slots[index];
+    return slot->next_free == ENTITY_ALIVE && slot->generation == ENTITY_GENERATION(entity);
 }
 
 
-List* get_children(Entity entity) {
+int get_parent(Entity entity) {
     TransformComponent* coord = get_component(entity, COMPONENT_TRANSFORM);
-    return coord->children;
+    return coord->parent;
 }
 
 
@@ -345,6 +779,5 @@ void look_at(Entity entity, Vector3 target) {
         up = vec3(0.0f, 0.0f, 1.0f);
     }
     Matrix4 transform = look_at_matrix(position, target, up);
-    TransformComponent* trans = get_component(entity, COMPONENT_TRANSFORM);
-    trans->rotation = rotation_from_transform(transform);
+    set_rotation(entity, rotation_from_transform(transform));
 }
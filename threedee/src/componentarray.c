@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "componentarray.h"
+#include "util.h"
+
+
+// Index pages are the same size for every array, so they share one pool
+static Pool* page_pool = NULL;
+
+
+Pool* ComponentArray_page_pool() {
+    if (!page_pool) {
+        page_pool = Pool_create(sizeof(int) * COMPONENT_PAGE_SIZE, 16);
+    }
+    return page_pool;
+}
+
+
+// The sparse entity-to-slot index is split into pages that are only allocated once an entity in
+// that range gets the component, so memory follows the entities actually using each type.
+static int* get_index(ComponentArray* array, Entity entity) {
+    int page = ENTITY_INDEX(entity) >> COMPONENT_PAGE_BITS;
+    if (page >= array->pages_size || !array->pages[page]) {
+        return NULL;
+    }
+    return &array->pages[page][ENTITY_INDEX(entity) & (COMPONENT_PAGE_SIZE - 1)];
+}
+
+
+static int* create_index(ComponentArray* array, Entity entity) {
+    int page = ENTITY_INDEX(entity) >> COMPONENT_PAGE_BITS;
+    if (page >= array->pages_size) {
+        int pages_size = array->pages_size ? array->pages_size : 1;
+        while (pages_size <= page) {
+            pages_size *= 2;
+        }
+        array->pages = realloc(array->pages, sizeof(int*) * pages_size);
+        for (int i = array->pages_size; i < pages_size; i++) {
+            array->pages[i] = NULL;
+        }
+        array->pages_size = pages_size;
+    }
+
+    if (!array->pages[page]) {
+        array->pages[page] = Pool_alloc(ComponentArray_page_pool());
+        for (int i = 0; i < COMPONENT_PAGE_SIZE; i++) {
+            array->pages[page][i] = -1;
+        }
+    }
+
+    return &array->pages[page][ENTITY_INDEX(entity) & (COMPONENT_PAGE_SIZE - 1)];
+}
+
+
+ComponentArray* ComponentArray_create(int element_size) {
+    ComponentArray* array = malloc(sizeof(ComponentArray));
+    array->size = 0;
+    array->capacity = 16;
+    array->element_size = element_size;
+    array->data = element_size > 0 ? malloc(element_size * array->capacity) : NULL;
+    array->entities = malloc(sizeof(Entity) * array->capacity);
+    array->pages = NULL;
+    array->pages_size = 0;
+    array->peak = 0;
+    array->grows = 0;
+    return array;
+}
+
+
+void ComponentArray_reserve(ComponentArray* array, int capacity) {
+    if (capacity <= array->capacity) {
+        return;
+    }
+
+    array->capacity = capacity;
+    if (array->element_size > 0) {
+        array->data = realloc(array->data, array->element_size * array->capacity);
+    }
+    array->entities = realloc(array->entities, sizeof(Entity) * array->capacity);
+    array->grows++;
+}
+
+
+void* ComponentArray_add(ComponentArray* array, Entity entity) {
+    if (entity < 0) {
+        LOG_ERROR("Invalid entity: %d", entity);
+        return NULL;
+    }
+
+    int* index = create_index(array, entity);
+    if (*index != -1) {
+        if (array->entities[*index] != entity) {
+            // Slot still belongs to an older entity with the same index, hand it over
+            array->entities[*index] = entity;
+            if (array->element_size > 0) {
+                memset(ComponentArray_at(array, *index), 0, array->element_size);
+            }
+        }
+        return ComponentArray_at(array, *index);
+    }
+
+    if (array->size >= array->capacity) {
+        ComponentArray_reserve(array, 2 * array->capacity);
+    }
+
+    *index = array->size;
+    array->size++;
+    if (array->size > array->peak) {
+        array->peak = array->size;
+    }
+    array->entities[*index] = entity;
+
+    void* component = ComponentArray_at(array, *index);
+    if (array->element_size > 0) {
+        memset(component, 0, array->element_size);
+    }
+    return component;
+}
+
+
+void* ComponentArray_get(ComponentArray* array, Entity entity) {
+    if (entity < 0) {
+        return NULL;
+    }
+
+    int* index = get_index(array, entity);
+    if (!index || *index == -1 || array->entities[*index] != entity) {
+        // No component, or the handle refers to an older entity in the same slot
+        return NULL;
+    }
+    return ComponentArray_at(array, *index);
+}
+
+
+void* ComponentArray_at(ComponentArray* array, int index) {
+    return (char*)array->data + index * array->element_size;
+}
+
+
+int ComponentArray_index(ComponentArray* array, Entity entity) {
+    if (entity < 0) {
+        return -1;
+    }
+
+    int* index = get_index(array, entity);
+    if (!index || *index == -1 || array->entities[*index] != entity) {
+        return -1;
+    }
+    return *index;
+}
+
+
+bool ComponentArray_has(ComponentArray* array, Entity entity) {
+    return ComponentArray_index(array, entity) != -1;
+}
+
+
+void ComponentArray_remove(ComponentArray* array, Entity entity) {
+    if (entity < 0) {
+        return;
+    }
+
+    int* index = get_index(array, entity);
+    if (!index || *index == -1 || array->entities[*index] != entity) {
+        return;
+    }
+
+    // Move the last component into the freed slot to keep the array packed
+    int last = array->size - 1;
+    if (*index != last) {
+        Entity moved = array->entities[last];
+        if (array->element_size > 0) {
+            memcpy(ComponentArray_at(array, *index), ComponentArray_at(array, last), array->element_size);
+        }
+        array->entities[*index] = moved;
+        *get_index(array, moved) = *index;
+    }
+
+    *index = -1;
+    array->size--;
+}
+
+
+void ComponentArray_clear(ComponentArray* array) {
+    for (int i = 0; i < array->size; i++) {
+        *get_index(array, array->entities[i]) = -1;
+    }
+    array->size = 0;
+}
+
+
+void ComponentArray_destroy(ComponentArray* array) {
+    for (int i = 0; i < array->pages_size; i++) {
+        Pool_free(ComponentArray_page_pool(), array->pages[i]);
+    }
+    free(array->pages);
+    free(array->data);
+    free(array->entities);
+    free(array);
+}
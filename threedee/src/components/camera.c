@@ -3,7 +3,7 @@
 
 
 CameraComponent* CameraComponent_add(Entity entity, Resolution resolution, float fov) {
-    CameraComponent* camera = malloc(sizeof(CameraComponent));
+    CameraComponent* camera = add_component(entity, COMPONENT_CAMERA);
 
     camera->resolution = resolution;
     camera->fov = fov;
@@ -15,15 +15,10 @@ CameraComponent* CameraComponent_add(Entity entity, Resolution resolution, float
         camera->fov, aspect_ratio, camera->near_plane, camera->far_plane
     );
 
-    scene->components->camera[entity] = camera;
     return camera;
 }
 
 
 void CameraComponent_remove(Entity entity) {
-    CameraComponent* camera = get_component(entity, COMPONENT_CAMERA);
-    if (camera) {
-        free(camera);
-        scene->components->camera[entity] = NULL;
-    }
+    release_component(entity, COMPONENT_CAMERA);
 }
@@ -1,6 +1,7 @@
 #define _USE_MATH_DEFINES
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "components/collider.h"
@@ -10,6 +11,14 @@
 
 #include "scene.h"
 #include "util.h"
+#include "resources.h"
+
+
+static const unsigned int COLLISION_MASKS[] = {
+    [GROUP_WALLS] = 0,
+    [GROUP_PLAYERS] = GROUP_WALLS,
+    [GROUP_PROPS] = GROUP_WALLS | GROUP_PLAYERS | GROUP_PROPS
+};
 
 
 float get_radius(Entity entity) {
@@ -96,16 +105,134 @@ Shape get_shape(Entity entity) {
                 .half_extents = get_half_extents(entity),
             };
             break;
+        case COLLIDER_MESH:
+            shape.mesh = (MeshShape) {
+                .center = position,
+                .scale = get_scale(entity),
+                .rotation = get_rotation(entity),
+                .mesh_index = collider->mesh_index
+            };
+            break;
+        case COLLIDER_HEIGHTFIELD:
+            shape.heightfield = (HeightfieldShape) {
+                .center = position,
+                .scale = get_scale(entity),
+                .rotation = get_rotation(entity),
+                .heightfield = collider->heightfield
+            };
+            break;
     }
 
     return shape;
 }
 
 
+static AABB transformed_bounds(Vector3 position, Vector3 scale, Quaternion rotation, Vector3 min, Vector3 max) {
+    // Bounds of a box given in the local frame of a scaled and rotated shape
+    Vector3 center = prod3(scale, mult3(0.5f, sum3(min, max)));
+    Vector3 abs_scale = vec3(fabsf(scale.x), fabsf(scale.y), fabsf(scale.z));
+    Vector3 half_extents = prod3(abs_scale, mult3(0.5f, diff3(max, min)));
+    Matrix3 rot = quaternion_to_rotation_matrix(rotation);
+    return (AABB) {
+        .center = sum3(position, matrix3_map(rot, center)),
+        .half_extents = matrix3_map(matrix3_abs(rot), half_extents)
+    };
+}
+
+
+static AABB shape_bounds(ColliderType type, Shape shape) {
+    switch (type) {
+        case COLLIDER_PLANE:
+            // Planes are unbounded, so they overlap everything
+            return (AABB) {
+                .center = zeros3(),
+                .half_extents = vec3(PLANE_BOUNDS, PLANE_BOUNDS, PLANE_BOUNDS)
+            };
+        case COLLIDER_SPHERE:
+            return (AABB) {
+                .center = shape.sphere.center,
+                .half_extents = vec3(shape.sphere.radius, shape.sphere.radius, shape.sphere.radius)
+            };
+        case COLLIDER_CUBOID: {
+            Matrix3 rot = matrix3_abs(quaternion_to_rotation_matrix(shape.cuboid.rotation));
+            return (AABB) {
+                .center = shape.cuboid.center,
+                .half_extents = matrix3_map(rot, shape.cuboid.half_extents)
+            };
+        }
+        case COLLIDER_CAPSULE: {
+            Matrix3 rot = quaternion_to_rotation_matrix(shape.capsule.rotation);
+            Vector3 up = mult3(0.5f * shape.capsule.height, matrix3_column(rot, 1));
+            float r = shape.capsule.radius;
+            return (AABB) {
+                .center = shape.capsule.center,
+                .half_extents = vec3(fabsf(up.x) + r, fabsf(up.y) + r, fabsf(up.z) + r)
+            };
+        }
+        case COLLIDER_AABB:
+            return shape.aabb;
+        case COLLIDER_MESH: {
+            Vector3 min;
+            Vector3 max;
+            BVH_bounds(resources.meshes[shape.mesh.mesh_index].bvh, &min, &max);
+            return transformed_bounds(shape.mesh.center, shape.mesh.scale, shape.mesh.rotation, min, max);
+        }
+        case COLLIDER_HEIGHTFIELD: {
+            Vector3 min;
+            Vector3 max;
+            Heightfield_bounds(shape.heightfield.heightfield, &min, &max);
+            return transformed_bounds(shape.heightfield.center, shape.heightfield.scale, shape.heightfield.rotation, min, max);
+        }
+    }
+
+    return (AABB) { 0 };
+}
+
+
+AABB get_bounds(Entity entity) {
+    ColliderComponent* collider = get_component(entity, COMPONENT_COLLIDER);
+    return shape_bounds(collider->type, get_shape(entity));
+}
+
+
+BodyType get_body_type(Entity entity) {
+    RigidBodyComponent* rigid_body = get_component(entity, COMPONENT_RIGIDBODY);
+    if (!rigid_body) {
+        return BODY_STATIC;
+    }
+    return rigid_body->inv_mass == 0.0f ? BODY_KINEMATIC : BODY_DYNAMIC;
+}
+
+
+void update_collider_shapes(ComponentArray* colliders) {
+    for (int k = 0; k < colliders->size; k++) {
+        Entity entity = colliders->entities[k];
+        ColliderComponent* collider = get_component(entity, COMPONENT_COLLIDER);
+        BodyType body = get_body_type(entity);
+
+        if (collider->static_shape && body == BODY_STATIC && !collider->shape_dirty) {
+            continue;
+        }
+
+        collider->shape = get_shape(entity);
+        collider->bounds = shape_bounds(collider->type, collider->shape);
+        collider->static_shape = (body == BODY_STATIC);
+    }
+}
+
+
+bool groups_collide(ColliderGroup group, ColliderGroup other_group) {
+    return (COLLISION_MASKS[group] & other_group) || (COLLISION_MASKS[other_group] & group);
+}
+
+
 void ColliderComponent_add(Entity entity, ColliderParameters parameters) {
-    ColliderComponent* collider = malloc(sizeof(ColliderComponent));
+    ColliderComponent* collider = add_component(entity, COMPONENT_COLLIDER);
     collider->type = parameters.type;
     collider->group = parameters.group ? parameters.group : GROUP_WALLS;
+    collider->mesh_index = -1;
+    collider->heightfield = NULL;
+    collider->sensor = parameters.sensor;
 
     switch (collider->type) {
         case COLLIDER_PLANE:
@@ -138,19 +265,52 @@ void ColliderComponent_add(Entity entity, ColliderParameters parameters) {
             collider->depth = parameters.depth ? parameters.depth : 1.0f;
             collider->radius = norm3(vec3(collider->width, collider->height, collider->depth)) / 2.0f;
             break;
+        case COLLIDER_MESH: {
+            int mesh_index = parameters.mesh ? binary_search_filename(parameters.mesh, resources.mesh_names, resources.meshes_size) : -1;
+            if (mesh_index == -1 || !resources.meshes[mesh_index].bvh) {
+                LOG_ERROR("Mesh not found: %s", parameters.mesh ? parameters.mesh : "");
+                release_component(entity, COMPONENT_COLLIDER);
+                return;
+            }
+            collider->mesh_index = mesh_index;
+
+            Vector3 min;
+            Vector3 max;
+            BVH_bounds(resources.meshes[mesh_index].bvh, &min, &max);
+            collider->width = max.x - min.x;
+            collider->height = max.y - min.y;
+            collider->depth = max.z - min.z;
+            collider->radius = norm3(vec3(collider->width, collider->height, collider->depth)) / 2.0f;
+            break;
+        }
+        case COLLIDER_HEIGHTFIELD: {
+            int samples = parameters.samples ? parameters.samples : 65;
+            int octaves = parameters.octaves ? parameters.octaves : 4;
+            float persistence = parameters.persistence ? parameters.persistence : 0.5f;
+            collider->heightfield = Heightfield_create_perlin(samples, samples, octaves, persistence);
+
+            collider->width = 1.0f;
+            collider->height = collider->heightfield->max_height - collider->heightfield->min_height;
+            collider->depth = 1.0f;
+            collider->radius = norm3(vec3(collider->width, collider->height, collider->depth)) / 2.0f;
+            break;
+        }
     }
 
-    collider->collisions = ArrayList_create(sizeof(Collision));
-    scene->components->collider[entity] = collider;
+    collider->events_start = 0;
+    collider->events_size = 0;
+    collider->static_shape = false;
+    collider->shape_dirty = true;
 }
 
 
 void ColliderComponent_remove(Entity entity) {
-    ColliderComponent* collider = scene->components->collider[entity];
+    ColliderComponent* collider = get_component(entity, COMPONENT_COLLIDER);
     if (collider) {
-        ArrayList_destroy(collider->collisions);
-        free(collider);
-        scene->components->collider[entity] = NULL;
+        if (collider->heightfield) {
+            Heightfield_destroy(collider->heightfield);
+        }
+        release_component(entity, COMPONENT_COLLIDER);
     }
 }
 
@@ -159,30 +319,32 @@ void draw_collider(Entity entity) {
     ColliderComponent* collider = get_component(entity, COMPONENT_COLLIDER);
     if (!collider) return;
 
-    Vector3 position = get_position(entity);
-    Vector3 scale = get_scale(entity);
-    Matrix3 rot = quaternion_to_rotation_matrix(get_rotation(entity));
-
+    Shape shape = collider->shape;
     Color color = get_color(1.0f, 0.0f, 0.0f, 0.5f);
 
     switch (collider->type) {
         case COLLIDER_PLANE: {
-            render_plane(get_shape(entity).plane, color);
+            render_plane(shape.plane, color);
             break;
         }
         case COLLIDER_SPHERE:
-            render_circle(position, collider->radius * scale.x, 32, color);
+            render_circle(shape.sphere.center, shape.sphere.radius, 32, color);
             break;
         case COLLIDER_CUBOID:
             break;
         case COLLIDER_CAPSULE:
-            Vector3 h = matrix3_map(rot, vec3(0.0f, collider->height / 2.0f, 0.0f));
-            Vector3 p0 = sum3(position, h);
-            Vector3 p1 = sum3(position, neg3(h));
-            render_sphere(p0, collider->radius, 16, color);
-            render_sphere(p1, collider->radius, 16, color);
+            Matrix3 rot = quaternion_to_rotation_matrix(shape.capsule.rotation);
+            Vector3 h = matrix3_map(rot, vec3(0.0f, shape.capsule.height / 2.0f, 0.0f));
+            Vector3 p0 = sum3(shape.capsule.center, h);
+            Vector3 p1 = sum3(shape.capsule.center, neg3(h));
+            render_sphere(p0, shape.capsule.radius, 16, color);
+            render_sphere(p1, shape.capsule.radius, 16, color);
             break;
         case COLLIDER_AABB:
             break;
+        case COLLIDER_MESH:
+            break;
+        case COLLIDER_HEIGHTFIELD:
+            break;
     }
 }
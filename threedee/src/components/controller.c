@@ -6,7 +6,7 @@
 
 
 ControllerComponent* ControllerComponent_add(Entity entity, int joystick) {
-    ControllerComponent* input = malloc(sizeof(ControllerComponent));
+    ControllerComponent* input = add_component(entity, COMPONENT_CONTROLLER);
 
     input->controller.joystick = joystick;
     int buttons[12] = {
@@ -33,15 +33,10 @@ ControllerComponent* ControllerComponent_add(Entity entity, int joystick) {
         input->controller.buttons_released[i] = false;
     }
 
-    scene->components->controller[entity] = input;
     return input;
 }
 
 
 void ControllerComponent_remove(Entity entity) {
-    ControllerComponent* controller = scene->components->controller[entity];
-    if (controller) {
-        free(controller);
-        scene->components->controller[entity] = NULL;
-    }
+    release_component(entity, COMPONENT_CONTROLLER);
 }
@@ -11,7 +11,7 @@
 
 
 LightComponent* LightComponent_add(Entity entity, LightParameters params) {
-    LightComponent* light = malloc(sizeof(LightComponent));
+    LightComponent* light = add_component(entity, COMPONENT_LIGHT);
     light->visibility_mask = params.visibility_mask ? params.visibility_mask : LIGHT_NORMAL;
     light->fov = params.fov ? params.fov : 90.0f;
     light->diffuse_color = params.color;
@@ -39,7 +39,7 @@ LightComponent* LightComponent_add(Entity entity, LightParameters params) {
             break;
         default:
             LOG_ERROR("Unknown light shape: %d", params.shape);
-            free(light);
+            release_component(entity, COMPONENT_LIGHT);
             return NULL;
     }
 
@@ -57,17 +57,14 @@ LightComponent* LightComponent_add(Entity entity, LightParameters params) {
     );
     light->shadow_map.projection_view_matrix = matrix4_id();
 
-    scene->components->light[entity] = light;
-
     return light;
 }
 
 
 void LightComponent_remove(Entity entity) {
-    LightComponent* light = scene->components->light[entity];
+    LightComponent* light = get_component(entity, COMPONENT_LIGHT);
     if (light) {
         SDL_ReleaseGPUTexture(app.gpu_device, light->shadow_map.depth_texture);
-        free(light);
-        scene->components->light[entity] = NULL;
+        release_component(entity, COMPONENT_LIGHT);
     }
 }
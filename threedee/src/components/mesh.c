@@ -7,7 +7,7 @@
 
 
 MeshComponent* MeshComponent_add(Entity entity, String mesh_filename, String texture_filename, String material_filename) {
-    MeshComponent* mesh = malloc(sizeof(MeshComponent));
+    MeshComponent* mesh = add_component(entity, COMPONENT_MESH);
     mesh->mesh_index = -1;
     mesh->texture_index = -1;
     mesh->material_index = -1;
@@ -17,7 +17,7 @@ MeshComponent* MeshComponent_add(Entity entity, String mesh_filename, String tex
         mesh->mesh_index = binary_search_filename(mesh_filename, resources.mesh_names, resources.meshes_size);
         if (mesh->mesh_index == -1) {
             LOG_ERROR("Mesh not found: %s", mesh_filename);
-            free(mesh);
+            release_component(entity, COMPONENT_MESH);
             return NULL;
         }
     }
@@ -36,15 +36,10 @@ MeshComponent* MeshComponent_add(Entity entity, String mesh_filename, String tex
         }
     }
 
-    scene->components->mesh[entity] = mesh;
     return mesh;
 }
 
 
 void MeshComponent_remove(Entity entity) {
-    MeshComponent* mesh = scene->components->mesh[entity];
-    if (mesh) {
-        free(mesh);
-        scene->components->mesh[entity] = NULL;
-    }
+    release_component(entity, COMPONENT_MESH);
 }
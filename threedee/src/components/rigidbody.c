@@ -5,7 +5,7 @@
 
 
 RigidBodyComponent* RigidBodyComponent_add(Entity entity, float mass) {
-    RigidBodyComponent* rigid_body = malloc(sizeof(RigidBodyComponent));
+    RigidBodyComponent* rigid_body = add_component(entity, COMPONENT_RIGIDBODY);
 
     rigid_body->velocity = zeros3();
     rigid_body->acceleration = zeros3();
@@ -23,22 +23,17 @@ RigidBodyComponent* RigidBodyComponent_add(Entity entity, float mass) {
     rigid_body->inv_inertia = matrix3_id();
     rigid_body->max_speed = 10.0f;
     rigid_body->max_angular_speed = 2.0f;
+    rigid_body->fast = false;
     rigid_body->axis_lock.x = false;
     rigid_body->axis_lock.y = false;
     rigid_body->axis_lock.z = false;
     rigid_body->axis_lock.rotation = false;
     rigid_body->axis_lock.rotation_axis = vec3(0.0f, 1.0f, 0.0f);
 
-    scene->components->rigid_body[entity] = rigid_body;
-
     return rigid_body;
 }
 
 
 void RigidBodyComponent_remove(Entity entity) {
-    RigidBodyComponent* ridig_body = scene->components->rigid_body[entity];
-    if (ridig_body) {
-        free(ridig_body);
-        scene->components->rigid_body[entity] = NULL;
-    }
+    release_component(entity, COMPONENT_RIGIDBODY);
 }
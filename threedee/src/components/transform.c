@@ -3,19 +3,23 @@
 
 
 TransformComponent* TransformComponent_add(Entity entity, Vector3 pos) {
-    TransformComponent* trans = malloc(sizeof(TransformComponent));
+    TransformComponent* trans = add_component(entity, COMPONENT_TRANSFORM);
     trans->position = pos;
     trans->rotation = (Quaternion) { 0.0f, 0.0f, 0.0f, 1.0f };
     trans->scale = ones3();
+    trans->world = matrix4_id();
+    trans->dirty = true;
     trans->parent = NULL_ENTITY;
-    trans->children = List_create();
+    trans->first_child = NULL_ENTITY;
+    trans->next_sibling = NULL_ENTITY;
+    trans->prev_sibling = NULL_ENTITY;
     trans->lifetime = -1.0f;
     trans->prefab[0] = '\0';
     trans->previous.position = pos;
     trans->previous.rotation = trans->rotation;
     trans->previous.scale = ones3();
 
-    scene->components->transform[entity] = trans;
+    scene->components->hierarchy.dirty = true;
 
     return trans;
 }
@@ -24,17 +28,9 @@ TransformComponent* TransformComponent_add(Entity entity, Vector3 pos) {
 void TransformComponent_remove(Entity entity) {
     TransformComponent* coord = get_component(entity, COMPONENT_TRANSFORM);
     if (coord) {
-        // if (coord->parent != -1) {
-        //     List_remove(CoordinateComponent_get(coord->parent)->children, entity);
-        // }
-        for (ListNode* node = coord->children->head; node; node = node->next) {
-            TransformComponent* child = get_component(node->value, COMPONENT_TRANSFORM);
-            if (child) {
-                child->parent = -1;
-            }
-        }
-        List_delete(coord->children);
-        free(coord);
-        scene->components->transform[entity] = NULL;
+        remove_parent(entity);
+        remove_children(entity);
+        release_component(entity, COMPONENT_TRANSFORM);
+        scene->components->hierarchy.dirty = true;
     }
-}
\ No newline at end of file
+}
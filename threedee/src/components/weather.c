@@ -3,21 +3,15 @@
 
 
 WeatherComponent* WeatherComponent_add(int entity, WeatherParameters parameters) {
-    WeatherComponent* weather = malloc(sizeof(WeatherComponent));
+    WeatherComponent* weather = add_component(entity, COMPONENT_WEATHER);
     weather->fog_color = parameters.fog_color;
     weather->fog_start = parameters.fog_start;
     weather->fog_end = parameters.fog_end;
 
-    scene->components->weather[entity] = weather;
-
     return weather;
 }
 
 
 void WeatherComponent_remove(int entity) {
-    WeatherComponent* weather = scene->components->weather[entity];
-    if (weather) {
-        free(weather);
-        scene->components->weather[entity] = NULL;
-    }
+    release_component(entity, COMPONENT_WEATHER);
 }
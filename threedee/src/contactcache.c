@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "contactcache.h"
+
+
+ContactCache* ContactCache_create() {
+    ContactCache* cache = malloc(sizeof(ContactCache));
+    cache->capacity = 64;
+    cache->manifolds = calloc(cache->capacity, sizeof(Manifold));
+    cache->buffer = calloc(cache->capacity, sizeof(Manifold));
+    cache->size = 0;
+    cache->tick = 0;
+    cache->events_capacity = 64;
+    cache->events = malloc(sizeof(ContactEvent) * cache->events_capacity);
+    cache->events_size = 0;
+    cache->entity_events = malloc(sizeof(int) * 2 * cache->events_capacity);
+    return cache;
+}
+
+
+static unsigned long long pair_key(Entity entity, Entity other) {
+    unsigned int low = (unsigned int) (entity < other ? entity : other);
+    unsigned int high = (unsigned int) (entity < other ? other : entity);
+    return ((unsigned long long) low << 32) | high;
+}
+
+
+static unsigned int hash_key(unsigned long long key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return (unsigned int) key;
+}
+
+
+static Manifold* probe(Manifold* manifolds, int capacity, unsigned long long key) {
+    // Linear probing, the table is kept at most half full
+    unsigned int mask = capacity - 1;
+    unsigned int slot = hash_key(key) & mask;
+    while (manifolds[slot].key != 0 && manifolds[slot].key != key) {
+        slot = (slot + 1) & mask;
+    }
+    return &manifolds[slot];
+}
+
+
+static void rehash(ContactCache* cache, int capacity, bool prune) {
+    // The spare table is reused so that pruning every tick does not allocate
+    if (capacity != cache->capacity) {
+        free(cache->buffer);
+        cache->buffer = malloc(sizeof(Manifold) * capacity);
+    }
+    memset(cache->buffer, 0, sizeof(Manifold) * capacity);
+
+    int size = 0;
+    for (int i = 0; i < cache->capacity; i++) {
+        Manifold* manifold = &cache->manifolds[i];
+        if (manifold->key == 0 || (prune && !manifold->touched)) {
+            continue;
+        }
+        Manifold* slot = probe(cache->buffer, capacity, manifold->key);
+        *slot = *manifold;
+        if (prune) {
+            slot->touched = false;
+        }
+        size++;
+    }
+
+    Manifold* manifolds = cache->manifolds;
+    cache->manifolds = cache->buffer;
+    cache->buffer = manifolds;
+    if (capacity != cache->capacity) {
+        free(cache->buffer);
+        cache->buffer = malloc(sizeof(Manifold) * capacity);
+        cache->capacity = capacity;
+    }
+    cache->size = size;
+}
+
+
+void ContactCache_reserve(ContactCache* cache, int size) {
+    // Indices returned by find stay valid until the table grows, so callers reserve room first
+    int capacity = cache->capacity;
+    while (2 * (cache->size + size) > capacity) {
+        capacity *= 2;
+    }
+    if (capacity != cache->capacity) {
+        rehash(cache, capacity, false);
+    }
+}
+
+
+int ContactCache_find(ContactCache* cache, Entity entity, Entity other) {
+    if (2 * (cache->size + 1) > cache->capacity) {
+        rehash(cache, 2 * cache->capacity, false);
+    }
+
+    unsigned long long key = pair_key(entity, other);
+    Manifold* manifold = probe(cache->manifolds, cache->capacity, key);
+    if (manifold->key == 0) {
+        manifold->key = key;
+        manifold->normal = zeros3();
+        manifold->size = 0;
+        manifold->axis = -1;
+        manifold->touching_tick = -1;
+        manifold->sensor = false;
+        cache->size++;
+    }
+    manifold->touched = true;
+
+    return manifold - cache->manifolds;
+}
+
+
+Manifold* ContactCache_get(ContactCache* cache, int index) {
+    return &cache->manifolds[index];
+}
+
+
+Contact* ContactCache_contact(ContactCache* cache, int index) {
+    // Contacts are numbered by manifold, then by point
+    return &cache->manifolds[index / MAX_MANIFOLD_POINTS].contacts[index % MAX_MANIFOLD_POINTS];
+}
+
+
+void ContactCache_prune(ContactCache* cache) {
+    rehash(cache, cache->capacity, true);
+}
+
+
+void ContactCache_clear_events(ContactCache* cache) {
+    cache->tick++;
+    cache->events_size = 0;
+}
+
+
+static void push_event(ContactCache* cache, ContactEventType type, int index) {
+    if (cache->events_size == cache->events_capacity) {
+        cache->events_capacity *= 2;
+        cache->events = realloc(cache->events, sizeof(ContactEvent) * cache->events_capacity);
+        cache->entity_events = realloc(cache->entity_events, sizeof(int) * 2 * cache->events_capacity);
+    }
+
+    unsigned long long key = cache->manifolds[index].key;
+    cache->events[cache->events_size++] = (ContactEvent) {
+        .type = type,
+        .entity = (Entity) (key >> 32),
+        .other = (Entity) (key & 0xffffffff),
+        .manifold = index,
+        .sensor = cache->manifolds[index].sensor
+    };
+}
+
+
+void ContactCache_add_event(ContactCache* cache, int index) {
+    // Pairs that touched in the previous update carry on, the rest begin
+    Manifold* manifold = &cache->manifolds[index];
+    ContactEventType type = manifold->touching_tick == cache->tick - 1 ? CONTACT_STAY : CONTACT_BEGIN;
+    manifold->touching_tick = cache->tick;
+    push_event(cache, type, index);
+}
+
+
+void ContactCache_end_events(ContactCache* cache) {
+    // Includes the pairs the broadphase no longer reports, which the next prune drops
+    for (int i = 0; i < cache->capacity; i++) {
+        Manifold* manifold = &cache->manifolds[i];
+        if (manifold->key != 0 && manifold->touching_tick == cache->tick - 1) {
+            push_event(cache, CONTACT_END, i);
+        }
+    }
+}
+
+
+void ContactCache_destroy(ContactCache* cache) {
+    free(cache->manifolds);
+    free(cache->buffer);
+    free(cache->events);
+    free(cache->entity_events);
+    free(cache);
+}
@@ -0,0 +1,212 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "heightfield.h"
+#include "linalg.h"
+#include "perlin.h"
+
+
+static float get_height(Heightfield* heightfield, int x, int z) {
+    return heightfield->heights[z * heightfield->width + x];
+}
+
+
+static Vector3 get_vertex(Heightfield* heightfield, int x, int z) {
+    return vec3(
+        (float) x / (float) (heightfield->width - 1) - 0.5f,
+        get_height(heightfield, x, z),
+        (float) z / (float) (heightfield->depth - 1) - 0.5f
+    );
+}
+
+
+Heightfield* Heightfield_create(int width, int depth) {
+    if (width < 2 || depth < 2) {
+        LOG_WARNING("Heightfield of %dx%d samples is too small, using 2x2", width, depth);
+        width = width < 2 ? 2 : width;
+        depth = depth < 2 ? 2 : depth;
+    }
+
+    Heightfield* heightfield = malloc(sizeof(Heightfield));
+    heightfield->width = width;
+    heightfield->depth = depth;
+    heightfield->heights = malloc(sizeof(float) * width * depth);
+    for (int i = 0; i < width * depth; i++) {
+        heightfield->heights[i] = 0.0f;
+    }
+    heightfield->min_height = 0.0f;
+    heightfield->max_height = 0.0f;
+
+    return heightfield;
+}
+
+
+Heightfield* Heightfield_create_perlin(int width, int depth, int octaves, float persistence) {
+    Heightfield* heightfield = Heightfield_create(width, depth);
+
+    Permutation p;
+    init_perlin(p);
+    for (int z = 0; z < heightfield->depth; z++) {
+        for (int x = 0; x < heightfield->width; x++) {
+            float u = HEIGHTFIELD_NOISE_SCALE * (float) x / (float) (heightfield->width - 1);
+            float v = HEIGHTFIELD_NOISE_SCALE * (float) z / (float) (heightfield->depth - 1);
+            // Noise is zero on the lattice, so the samples are taken between its planes
+            heightfield->heights[z * heightfield->width + x] = octave_perlin(u, 0.5f, v, p, 0, octaves, persistence);
+        }
+    }
+    Heightfield_update_bounds(heightfield);
+
+    return heightfield;
+}
+
+
+void Heightfield_update_bounds(Heightfield* heightfield) {
+    heightfield->min_height = INFINITY;
+    heightfield->max_height = -INFINITY;
+    for (int i = 0; i < heightfield->width * heightfield->depth; i++) {
+        heightfield->min_height = fminf(heightfield->min_height, heightfield->heights[i]);
+        heightfield->max_height = fmaxf(heightfield->max_height, heightfield->heights[i]);
+    }
+}
+
+
+Triangle Heightfield_triangle(Heightfield* heightfield, int triangle) {
+    // Two triangles per cell, split along the diagonal from its first to its last sample
+    int cell = triangle / 2;
+    int x = cell % (heightfield->width - 1);
+    int z = cell / (heightfield->width - 1);
+
+    if (triangle % 2 == 0) {
+        return (Triangle) {
+            .a = get_vertex(heightfield, x, z),
+            .b = get_vertex(heightfield, x, z + 1),
+            .c = get_vertex(heightfield, x + 1, z + 1)
+        };
+    }
+    return (Triangle) {
+        .a = get_vertex(heightfield, x, z),
+        .b = get_vertex(heightfield, x + 1, z + 1),
+        .c = get_vertex(heightfield, x + 1, z)
+    };
+}
+
+
+void Heightfield_bounds(Heightfield* heightfield, Vector3* min, Vector3* max) {
+    *min = vec3(-0.5f, heightfield->min_height, -0.5f);
+    *max = vec3(0.5f, heightfield->max_height, 0.5f);
+}
+
+
+void Heightfield_query(Heightfield* heightfield, Vector3 min, Vector3 max, HeightfieldQueryCallback callback, void* data) {
+    if (max.x < -0.5f || min.x > 0.5f || max.z < -0.5f || min.z > 0.5f) return;
+    if (max.y < heightfield->min_height || min.y > heightfield->max_height) return;
+
+    // The cells under the bounds are read off the grid directly
+    int cells_x = heightfield->width - 1;
+    int cells_z = heightfield->depth - 1;
+    int x0 = (int) clamp(floorf((min.x + 0.5f) * cells_x), 0.0f, (float) (cells_x - 1));
+    int x1 = (int) clamp(floorf((max.x + 0.5f) * cells_x), 0.0f, (float) (cells_x - 1));
+    int z0 = (int) clamp(floorf((min.z + 0.5f) * cells_z), 0.0f, (float) (cells_z - 1));
+    int z1 = (int) clamp(floorf((max.z + 0.5f) * cells_z), 0.0f, (float) (cells_z - 1));
+
+    for (int z = z0; z <= z1; z++) {
+        for (int x = x0; x <= x1; x++) {
+            float h00 = get_height(heightfield, x, z);
+            float h10 = get_height(heightfield, x + 1, z);
+            float h01 = get_height(heightfield, x, z + 1);
+            float h11 = get_height(heightfield, x + 1, z + 1);
+            float low = fminf(fminf(h00, h10), fminf(h01, h11));
+            float high = fmaxf(fmaxf(h00, h10), fmaxf(h01, h11));
+            if (high < min.y || low > max.y) continue;
+
+            int cell = z * cells_x + x;
+            if (!callback(data, 2 * cell) || !callback(data, 2 * cell + 1)) {
+                return;
+            }
+        }
+    }
+}
+
+
+float Heightfield_raycast(Heightfield* heightfield, Vector3 origin, Vector3 direction, float max_distance, Vector3* normal) {
+    // Clip the ray to the bounds, then walk the cells it crosses in order until a triangle is hit
+    Vector3 min;
+    Vector3 max;
+    Heightfield_bounds(heightfield, &min, &max);
+
+    float t_enter = 0.0f;
+    float t_exit = max_distance;
+    float origins[3] = { origin.x, origin.y, origin.z };
+    float directions[3] = { direction.x, direction.y, direction.z };
+    float mins[3] = { min.x, min.y, min.z };
+    float maxs[3] = { max.x, max.y, max.z };
+    for (int k = 0; k < 3; k++) {
+        if (fabsf(directions[k]) < 1e-12f) {
+            if (origins[k] < mins[k] || origins[k] > maxs[k]) return INFINITY;
+            continue;
+        }
+        float t0 = (mins[k] - origins[k]) / directions[k];
+        float t1 = (maxs[k] - origins[k]) / directions[k];
+        t_enter = fmaxf(t_enter, fminf(t0, t1));
+        t_exit = fminf(t_exit, fmaxf(t0, t1));
+    }
+    if (t_enter > t_exit) {
+        return INFINITY;
+    }
+
+    int cells_x = heightfield->width - 1;
+    int cells_z = heightfield->depth - 1;
+    Vector3 start = sum3(origin, mult3(t_enter, direction));
+    int x = (int) clamp(floorf((start.x + 0.5f) * cells_x), 0.0f, (float) (cells_x - 1));
+    int z = (int) clamp(floorf((start.z + 0.5f) * cells_z), 0.0f, (float) (cells_z - 1));
+
+    int step_x = direction.x > 0.0f ? 1 : -1;
+    int step_z = direction.z > 0.0f ? 1 : -1;
+    float delta_x = fabsf(direction.x) > 1e-12f ? 1.0f / (cells_x * fabsf(direction.x)) : INFINITY;
+    float delta_z = fabsf(direction.z) > 1e-12f ? 1.0f / (cells_z * fabsf(direction.z)) : INFINITY;
+    float next_x = fabsf(direction.x) > 1e-12f
+        ? ((float) (x + (step_x > 0)) / cells_x - 0.5f - origin.x) / direction.x : INFINITY;
+    float next_z = fabsf(direction.z) > 1e-12f
+        ? ((float) (z + (step_z > 0)) / cells_z - 0.5f - origin.z) / direction.z : INFINITY;
+
+    while (x >= 0 && x < cells_x && z >= 0 && z < cells_z) {
+        int cell = z * cells_x + x;
+        float distance = INFINITY;
+        Triangle hit;
+        for (int k = 0; k < 2; k++) {
+            Triangle triangle = Heightfield_triangle(heightfield, 2 * cell + k);
+            float t = ray_triangle_distance(triangle, origin, direction);
+            if (t < distance) {
+                distance = t;
+                hit = triangle;
+            }
+        }
+
+        if (distance <= t_exit) {
+            *normal = normalized3(cross(diff3(hit.b, hit.a), diff3(hit.c, hit.a)));
+            if (dot3(*normal, direction) > 0.0f) {
+                *normal = neg3(*normal);
+            }
+            return distance;
+        }
+
+        if (fminf(next_x, next_z) > t_exit) break;
+
+        if (next_x < next_z) {
+            x += step_x;
+            next_x += delta_x;
+        } else {
+            z += step_z;
+            next_z += delta_z;
+        }
+    }
+
+    return INFINITY;
+}
+
+
+void Heightfield_destroy(Heightfield* heightfield) {
+    free(heightfield->heights);
+    free(heightfield);
+}
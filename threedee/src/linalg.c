@@ -183,6 +183,10 @@ Vector3 div3(float c, Vector3 v) {
     return (Vector3) { v.x / c, v.y / c, v.z / c };
 }
 
+Vector3 prod3(Vector3 v, Vector3 u) {
+    return (Vector3) { v.x * u.x, v.y * u.y, v.z * u.z };
+}
+
 Vector2 proj(Vector2 a, Vector2 b) {
     Vector2 b_norm = normalized2(b);
     return mult(dot2(a, b_norm), b_norm);
@@ -0,0 +1,490 @@
+#include <stdlib.h>
+
+// Defining NARROWPHASE_SCALAR leaves out the vector kernels, so the fallback can be tested on any machine
+#if defined(__SSE2__) && !defined(NARROWPHASE_SCALAR)
+    #define NARROWPHASE_SSE
+    #include <emmintrin.h>
+#endif
+
+#include "narrowphase.h"
+#include "scene.h"
+#include "threadpool.h"
+
+
+Narrowphase* Narrowphase_create() {
+    Narrowphase* narrowphase = malloc(sizeof(Narrowphase));
+    for (int b = 0; b < BATCH_COUNT; b++) {
+        NarrowphaseBatch* batch = &narrowphase->batches[b];
+        batch->size = 0;
+        batch->capacity = 16;
+        batch->indices = malloc(sizeof(int) * batch->capacity);
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            batch->fields[f] = malloc(sizeof(float) * batch->capacity);
+        }
+    }
+    narrowphase->capacity = 64;
+    narrowphase->keys = malloc(sizeof(unsigned long long) * narrowphase->capacity);
+    narrowphase->pairs = malloc(sizeof(CollisionPair) * narrowphase->capacity);
+    narrowphase->axes = malloc(sizeof(int*) * narrowphase->capacity);
+    narrowphase->general = malloc(sizeof(int) * narrowphase->capacity);
+    narrowphase->general_size = 0;
+    narrowphase->sensors = malloc(sizeof(int) * narrowphase->capacity);
+    narrowphase->sensors_size = 0;
+    narrowphase->penetrations = malloc(sizeof(Penetration) * narrowphase->capacity);
+    narrowphase->size = 0;
+    return narrowphase;
+}
+
+
+void Narrowphase_reset(Narrowphase* narrowphase, int size) {
+    if (size > narrowphase->capacity) {
+        narrowphase->capacity = 2 * size;
+        free(narrowphase->keys);
+        free(narrowphase->pairs);
+        free(narrowphase->axes);
+        free(narrowphase->general);
+        free(narrowphase->sensors);
+        free(narrowphase->penetrations);
+        narrowphase->keys = malloc(sizeof(unsigned long long) * narrowphase->capacity);
+        narrowphase->pairs = malloc(sizeof(CollisionPair) * narrowphase->capacity);
+        narrowphase->axes = malloc(sizeof(int*) * narrowphase->capacity);
+        narrowphase->general = malloc(sizeof(int) * narrowphase->capacity);
+        narrowphase->sensors = malloc(sizeof(int) * narrowphase->capacity);
+        narrowphase->penetrations = malloc(sizeof(Penetration) * narrowphase->capacity);
+    }
+    narrowphase->size = size;
+    narrowphase->general_size = 0;
+    narrowphase->sensors_size = 0;
+    for (int b = 0; b < BATCH_COUNT; b++) {
+        narrowphase->batches[b].size = 0;
+    }
+}
+
+
+static int push_entry(NarrowphaseBatch* batch, int index) {
+    if (batch->size == batch->capacity) {
+        batch->capacity *= 2;
+        batch->indices = realloc(batch->indices, sizeof(int) * batch->capacity);
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            batch->fields[f] = realloc(batch->fields[f], sizeof(float) * batch->capacity);
+        }
+    }
+    batch->indices[batch->size] = index;
+    return batch->size++;
+}
+
+
+void Narrowphase_add(Narrowphase* narrowphase, int index, Entity entity, Entity other, int* axis) {
+    narrowphase->pairs[index] = (CollisionPair) { .entity = entity, .other = other };
+    narrowphase->axes[index] = axis;
+
+    ColliderComponent* collider = get_component(entity, COMPONENT_COLLIDER);
+    ColliderComponent* other_collider = get_component(other, COMPONENT_COLLIDER);
+    if (!collider || !other_collider) {
+        narrowphase->general[narrowphase->general_size++] = index;
+        return;
+    }
+
+    if (collider->sensor || other_collider->sensor) {
+        narrowphase->sensors[narrowphase->sensors_size++] = index;
+        return;
+    }
+
+    // Put the box second, the overlap is flipped back once the batch has run
+    float sign = 1.0f;
+    if (collider->type == COLLIDER_AABB) {
+        ColliderComponent* swap = collider;
+        collider = other_collider;
+        other_collider = swap;
+        sign = -1.0f;
+    }
+
+    BatchType type;
+    if (collider->type == COLLIDER_SPHERE && other_collider->type == COLLIDER_SPHERE) {
+        type = BATCH_SPHERE_SPHERE;
+    } else if (collider->type == COLLIDER_SPHERE && other_collider->type == COLLIDER_AABB) {
+        type = BATCH_SPHERE_AABB;
+    } else if (collider->type == COLLIDER_CAPSULE && other_collider->type == COLLIDER_AABB) {
+        type = BATCH_CAPSULE_AABB;
+    } else {
+        narrowphase->general[narrowphase->general_size++] = index;
+        return;
+    }
+
+    NarrowphaseBatch* batch = &narrowphase->batches[type];
+    int k = push_entry(batch, index);
+    float** fields = batch->fields;
+    Shape shape = collider->shape;
+    Shape shape_other = other_collider->shape;
+
+    switch (type) {
+        case BATCH_SPHERE_SPHERE:
+            fields[FIELD_X][k] = shape.sphere.center.x;
+            fields[FIELD_Y][k] = shape.sphere.center.y;
+            fields[FIELD_Z][k] = shape.sphere.center.z;
+            fields[FIELD_RADIUS][k] = shape.sphere.radius;
+            fields[FIELD_OTHER_X][k] = shape_other.sphere.center.x;
+            fields[FIELD_OTHER_Y][k] = shape_other.sphere.center.y;
+            fields[FIELD_OTHER_Z][k] = shape_other.sphere.center.z;
+            fields[FIELD_OTHER_RADIUS][k] = shape_other.sphere.radius;
+            break;
+        case BATCH_SPHERE_AABB:
+            fields[FIELD_X][k] = shape.sphere.center.x;
+            fields[FIELD_Y][k] = shape.sphere.center.y;
+            fields[FIELD_Z][k] = shape.sphere.center.z;
+            fields[FIELD_RADIUS][k] = shape.sphere.radius;
+            fields[FIELD_OTHER_X][k] = shape_other.aabb.center.x;
+            fields[FIELD_OTHER_Y][k] = shape_other.aabb.center.y;
+            fields[FIELD_OTHER_Z][k] = shape_other.aabb.center.z;
+            fields[FIELD_EXTENT_X][k] = shape_other.aabb.half_extents.x;
+            fields[FIELD_EXTENT_Y][k] = shape_other.aabb.half_extents.y;
+            fields[FIELD_EXTENT_Z][k] = shape_other.aabb.half_extents.z;
+            break;
+        case BATCH_CAPSULE_AABB: {
+            Matrix3 rot = quaternion_to_rotation_matrix(shape.capsule.rotation);
+            Vector3 axis = matrix3_map(rot, vec3(0.0f, shape.capsule.height / 2.0f, 0.0f));
+            fields[FIELD_X][k] = shape.capsule.center.x;
+            fields[FIELD_Y][k] = shape.capsule.center.y;
+            fields[FIELD_Z][k] = shape.capsule.center.z;
+            fields[FIELD_RADIUS][k] = shape.capsule.radius;
+            fields[FIELD_AXIS_X][k] = axis.x;
+            fields[FIELD_AXIS_Y][k] = axis.y;
+            fields[FIELD_AXIS_Z][k] = axis.z;
+            fields[FIELD_OTHER_X][k] = shape_other.aabb.center.x;
+            fields[FIELD_OTHER_Y][k] = shape_other.aabb.center.y;
+            fields[FIELD_OTHER_Z][k] = shape_other.aabb.center.z;
+            fields[FIELD_EXTENT_X][k] = shape_other.aabb.half_extents.x;
+            fields[FIELD_EXTENT_Y][k] = shape_other.aabb.half_extents.y;
+            fields[FIELD_EXTENT_Z][k] = shape_other.aabb.half_extents.z;
+            break;
+        }
+        default:
+            break;
+    }
+    fields[FIELD_SIGN][k] = sign;
+}
+
+
+static Vector3 field3(NarrowphaseBatch* batch, BatchField field, int k) {
+    return vec3(batch->fields[field][k], batch->fields[field + 1][k], batch->fields[field + 2][k]);
+}
+
+
+static Penetration penetration_capsule_axis_aabb(Vector3 center, Vector3 h, float radius, AABB aabb) {
+    // Same as penetration_capsule_aabb, with the rotation of the capsule already applied
+    Penetration penetration = {
+        .valid = false
+    };
+
+    Vector3 p0 = sum3(center, h);
+    Vector3 p1 = sum3(center, neg3(h));
+
+    Vector3 closest_to_box = closest_point_on_aabb(aabb, center);
+    Vector3 closest_on_segment = closest_point_on_segment(p0, p1, closest_to_box);
+    Vector3 closest_on_box = closest_point_on_aabb(aabb, closest_on_segment);
+
+    Vector3 diff = diff3(closest_on_segment, closest_on_box);
+    float dist = norm3(diff);
+
+    if (dist < radius) {
+        float depth = radius - dist;
+        Vector3 direction = diff3(aabb.center, center);
+        if (dist >= 1e-6f) {
+            direction = div3(dist, diff);
+        }
+        penetration.valid = true;
+        penetration.overlap = mult3(depth, direction);
+        penetration.contact_point = sum3(closest_on_segment, mult3(-radius, direction));
+    }
+
+    return penetration;
+}
+
+
+static Penetration penetration_entry(BatchType type, NarrowphaseBatch* batch, int k) {
+    // Scalar fallback, also the reference for the vector kernels
+    float** fields = batch->fields;
+    Vector3 center = field3(batch, FIELD_X, k);
+    Vector3 center_other = field3(batch, FIELD_OTHER_X, k);
+    float radius = fields[FIELD_RADIUS][k];
+    AABB aabb = {
+        .center = center_other,
+        .half_extents = field3(batch, FIELD_EXTENT_X, k)
+    };
+
+    Penetration penetration = {
+        .valid = false
+    };
+    switch (type) {
+        case BATCH_SPHERE_SPHERE: {
+            Sphere sphere = { .center = center, .radius = radius };
+            Sphere sphere_other = { .center = center_other, .radius = fields[FIELD_OTHER_RADIUS][k] };
+            penetration = penetration_sphere_sphere(sphere, sphere_other);
+            break;
+        }
+        case BATCH_SPHERE_AABB: {
+            Sphere sphere = { .center = center, .radius = radius };
+            penetration = penetration_sphere_aabb(sphere, aabb);
+            break;
+        }
+        case BATCH_CAPSULE_AABB:
+            penetration = penetration_capsule_axis_aabb(center, field3(batch, FIELD_AXIS_X, k), radius, aabb);
+            break;
+        default:
+            break;
+    }
+
+    if (penetration.valid) {
+        penetration.overlap = mult3(fields[FIELD_SIGN][k], penetration.overlap);
+    }
+    return penetration;
+}
+
+
+#ifdef NARROWPHASE_SSE
+
+typedef struct {
+    __m128 x;
+    __m128 y;
+    __m128 z;
+} Lanes3;
+
+
+static __m128 load_lanes(NarrowphaseBatch* batch, BatchField field, int k) {
+    return _mm_loadu_ps(batch->fields[field] + k);
+}
+
+
+static Lanes3 load_lanes3(NarrowphaseBatch* batch, BatchField field, int k) {
+    return (Lanes3) { load_lanes(batch, field, k), load_lanes(batch, field + 1, k), load_lanes(batch, field + 2, k) };
+}
+
+
+static Lanes3 sum_lanes3(Lanes3 a, Lanes3 b) {
+    return (Lanes3) { _mm_add_ps(a.x, b.x), _mm_add_ps(a.y, b.y), _mm_add_ps(a.z, b.z) };
+}
+
+
+static Lanes3 diff_lanes3(Lanes3 a, Lanes3 b) {
+    return (Lanes3) { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) };
+}
+
+
+static Lanes3 mult_lanes3(__m128 c, Lanes3 v) {
+    return (Lanes3) { _mm_mul_ps(c, v.x), _mm_mul_ps(c, v.y), _mm_mul_ps(c, v.z) };
+}
+
+
+static __m128 dot_lanes3(Lanes3 a, Lanes3 b) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+}
+
+
+static __m128 clamp_lanes(__m128 v, __m128 min, __m128 max) {
+    // Same order as clamp, so that the results match bit for bit
+    return _mm_max_ps(_mm_min_ps(v, max), min);
+}
+
+
+static Lanes3 clamp_lanes3(Lanes3 v, Lanes3 min, Lanes3 max) {
+    return (Lanes3) { clamp_lanes(v.x, min.x, max.x), clamp_lanes(v.y, min.y, max.y), clamp_lanes(v.z, min.z, max.z) };
+}
+
+
+static Lanes3 select_lanes3(__m128 mask, Lanes3 a, Lanes3 b) {
+    return (Lanes3) {
+        _mm_or_ps(_mm_and_ps(mask, a.x), _mm_andnot_ps(mask, b.x)),
+        _mm_or_ps(_mm_and_ps(mask, a.y), _mm_andnot_ps(mask, b.y)),
+        _mm_or_ps(_mm_and_ps(mask, a.z), _mm_andnot_ps(mask, b.z))
+    };
+}
+
+
+static void store_lanes(Narrowphase* narrowphase, NarrowphaseBatch* batch, int k, __m128 valid, Lanes3 overlap,
+        Lanes3 contact_point) {
+    float values[6][NARROWPHASE_LANES];
+    _mm_storeu_ps(values[0], overlap.x);
+    _mm_storeu_ps(values[1], overlap.y);
+    _mm_storeu_ps(values[2], overlap.z);
+    _mm_storeu_ps(values[3], contact_point.x);
+    _mm_storeu_ps(values[4], contact_point.y);
+    _mm_storeu_ps(values[5], contact_point.z);
+
+    int mask = _mm_movemask_ps(valid);
+    for (int lane = 0; lane < NARROWPHASE_LANES; lane++) {
+        Penetration* penetration = &narrowphase->penetrations[batch->indices[k + lane]];
+        *penetration = (Penetration) {
+            .valid = false
+        };
+        if (mask & (1 << lane)) {
+            penetration->valid = true;
+            penetration->overlap = vec3(values[0][lane], values[1][lane], values[2][lane]);
+            penetration->contact_point = vec3(values[3][lane], values[4][lane], values[5][lane]);
+        }
+    }
+}
+
+
+static int run_lanes(Narrowphase* narrowphase, BatchType type, NarrowphaseBatch* batch, int start, int end) {
+    // Each step follows the scalar tests operation by operation, so both paths give the same results
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    int k = start;
+    for (; k + NARROWPHASE_LANES <= end; k += NARROWPHASE_LANES) {
+        Lanes3 center = load_lanes3(batch, FIELD_X, k);
+        Lanes3 center_other = load_lanes3(batch, FIELD_OTHER_X, k);
+        __m128 radius = load_lanes(batch, FIELD_RADIUS, k);
+        __m128 sign = load_lanes(batch, FIELD_SIGN, k);
+
+        __m128 valid;
+        Lanes3 overlap;
+        Lanes3 contact_point;
+
+        switch (type) {
+            case BATCH_SPHERE_SPHERE: {
+                Lanes3 diff = diff_lanes3(center, center_other);
+                __m128 dist_sq = dot_lanes3(diff, diff);
+                __m128 radius_sum = _mm_add_ps(radius, load_lanes(batch, FIELD_OTHER_RADIUS, k));
+                __m128 dist = _mm_sqrt_ps(dist_sq);
+                valid = _mm_and_ps(_mm_cmplt_ps(dist_sq, _mm_mul_ps(radius_sum, radius_sum)), _mm_cmpneq_ps(dist, zero));
+                overlap = mult_lanes3(_mm_div_ps(_mm_sub_ps(radius_sum, dist), dist), diff);
+                contact_point = sum_lanes3(center, mult_lanes3(_mm_div_ps(radius, radius_sum), diff));
+                break;
+            }
+            case BATCH_SPHERE_AABB: {
+                Lanes3 half_extents = load_lanes3(batch, FIELD_EXTENT_X, k);
+                Lanes3 closest = clamp_lanes3(
+                    center, diff_lanes3(center_other, half_extents), sum_lanes3(center_other, half_extents)
+                );
+                Lanes3 diff = diff_lanes3(center, closest);
+                __m128 dist_sq = dot_lanes3(diff, diff);
+                __m128 radius_sum = _mm_add_ps(radius, zero);
+                __m128 dist = _mm_sqrt_ps(dist_sq);
+                valid = _mm_and_ps(_mm_cmplt_ps(dist_sq, _mm_mul_ps(radius_sum, radius_sum)), _mm_cmpneq_ps(dist, zero));
+                overlap = mult_lanes3(_mm_div_ps(_mm_sub_ps(radius_sum, dist), dist), diff);
+                contact_point = closest;
+                break;
+            }
+            case BATCH_CAPSULE_AABB: {
+                Lanes3 h = load_lanes3(batch, FIELD_AXIS_X, k);
+                Lanes3 half_extents = load_lanes3(batch, FIELD_EXTENT_X, k);
+                Lanes3 box_min = diff_lanes3(center_other, half_extents);
+                Lanes3 box_max = sum_lanes3(center_other, half_extents);
+
+                Lanes3 p0 = sum_lanes3(center, h);
+                Lanes3 p1 = diff_lanes3(center, h);
+
+                Lanes3 closest_to_box = clamp_lanes3(center, box_min, box_max);
+                Lanes3 segment = diff_lanes3(p1, p0);
+                __m128 t = _mm_div_ps(dot_lanes3(diff_lanes3(closest_to_box, p0), segment), dot_lanes3(segment, segment));
+                t = clamp_lanes(t, zero, one);
+                Lanes3 closest_on_segment = sum_lanes3(p0, mult_lanes3(t, segment));
+                Lanes3 closest_on_box = clamp_lanes3(closest_on_segment, box_min, box_max);
+
+                Lanes3 diff = diff_lanes3(closest_on_segment, closest_on_box);
+                __m128 dist = _mm_sqrt_ps(dot_lanes3(diff, diff));
+                valid = _mm_cmplt_ps(dist, radius);
+
+                Lanes3 normalized = {
+                    _mm_div_ps(diff.x, dist), _mm_div_ps(diff.y, dist), _mm_div_ps(diff.z, dist)
+                };
+                Lanes3 direction = select_lanes3(
+                    _mm_cmpge_ps(dist, _mm_set1_ps(1e-6f)), normalized, diff_lanes3(center_other, center)
+                );
+                overlap = mult_lanes3(_mm_sub_ps(radius, dist), direction);
+                contact_point = sum_lanes3(closest_on_segment, mult_lanes3(_mm_xor_ps(radius, _mm_set1_ps(-0.0f)), direction));
+                break;
+            }
+            default:
+                return start;
+        }
+
+        store_lanes(narrowphase, batch, k, valid, mult_lanes3(sign, overlap), contact_point);
+    }
+
+    return k;
+}
+
+#endif
+
+
+typedef struct {
+    Narrowphase* narrowphase;
+    BatchType type;
+} BatchJob;
+
+
+static void run_batch_range(void* data, int start, int end) {
+    // Ranges are counted in groups of lanes, so that only the last group of a batch can be partial
+    BatchJob* job = data;
+    NarrowphaseBatch* batch = &job->narrowphase->batches[job->type];
+    start *= NARROWPHASE_LANES;
+    end = mini(end * NARROWPHASE_LANES, batch->size);
+
+    int k = start;
+    #ifdef NARROWPHASE_SSE
+        k = run_lanes(job->narrowphase, job->type, batch, start, end);
+    #endif
+    for (; k < end; k++) {
+        job->narrowphase->penetrations[batch->indices[k]] = penetration_entry(job->type, batch, k);
+    }
+}
+
+
+static void run_general_range(void* data, int start, int end) {
+    Narrowphase* narrowphase = data;
+    for (int k = start; k < end; k++) {
+        int index = narrowphase->general[k];
+        CollisionPair pair = narrowphase->pairs[index];
+        narrowphase->penetrations[index] = get_penetration_cached(pair.entity, pair.other, narrowphase->axes[index]);
+    }
+}
+
+
+static void run_sensor_range(void* data, int start, int end) {
+    Narrowphase* narrowphase = data;
+    for (int k = start; k < end; k++) {
+        int index = narrowphase->sensors[k];
+        CollisionPair pair = narrowphase->pairs[index];
+        narrowphase->penetrations[index] = (Penetration) {
+            .valid = test_overlap(pair.entity, pair.other, narrowphase->axes[index]),
+            .contacts_size = 0
+        };
+    }
+}
+
+
+void Narrowphase_run(Narrowphase* narrowphase) {
+    ThreadPool_parallel_for(thread_pool, 0, narrowphase->general_size, NARROWPHASE_BATCH_SIZE, run_general_range,
+        narrowphase);
+    ThreadPool_parallel_for(thread_pool, 0, narrowphase->sensors_size, NARROWPHASE_BATCH_SIZE, run_sensor_range,
+        narrowphase);
+
+    for (int b = 0; b < BATCH_COUNT; b++) {
+        BatchJob job = {
+            .narrowphase = narrowphase,
+            .type = b
+        };
+        int groups = (narrowphase->batches[b].size + NARROWPHASE_LANES - 1) / NARROWPHASE_LANES;
+        ThreadPool_parallel_for(thread_pool, 0, groups, NARROWPHASE_BATCH_SIZE / NARROWPHASE_LANES, run_batch_range,
+            &job);
+    }
+}
+
+
+void Narrowphase_destroy(Narrowphase* narrowphase) {
+    for (int b = 0; b < BATCH_COUNT; b++) {
+        free(narrowphase->batches[b].indices);
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            free(narrowphase->batches[b].fields[f]);
+        }
+    }
+    free(narrowphase->keys);
+    free(narrowphase->pairs);
+    free(narrowphase->axes);
+    free(narrowphase->general);
+    free(narrowphase->sensors);
+    free(narrowphase->penetrations);
+    free(narrowphase);
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+#include "util.h"
+
+
+Pool* Pool_create(int block_size, int chunk_blocks) {
+    Pool* pool = malloc(sizeof(Pool));
+    // Free blocks store the next free block in their first bytes
+    if (block_size < (int)sizeof(void*)) {
+        block_size = sizeof(void*);
+    }
+    pool->block_size = (block_size + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+    pool->chunk_blocks = chunk_blocks;
+    pool->chunks = NULL;
+    pool->chunks_size = 0;
+    pool->free_list = NULL;
+    pool->used = 0;
+    pool->peak = 0;
+    pool->allocations = 0;
+    pool->frees = 0;
+    return pool;
+}
+
+
+static void add_chunk(Pool* pool) {
+    char* chunk = malloc(pool->block_size * pool->chunk_blocks);
+    pool->chunks = realloc(pool->chunks, sizeof(void*) * (pool->chunks_size + 1));
+    pool->chunks[pool->chunks_size] = chunk;
+    pool->chunks_size++;
+
+    // Thread blocks in reverse so they are handed out in address order
+    for (int i = pool->chunk_blocks - 1; i >= 0; i--) {
+        void* block = chunk + i * pool->block_size;
+        *(void**)block = pool->free_list;
+        pool->free_list = block;
+    }
+}
+
+
+void* Pool_alloc(Pool* pool) {
+    if (!pool->free_list) {
+        add_chunk(pool);
+    }
+
+    void* block = pool->free_list;
+    pool->free_list = *(void**)block;
+
+    pool->used++;
+    pool->allocations++;
+    if (pool->used > pool->peak) {
+        pool->peak = pool->used;
+    }
+    return block;
+}
+
+
+void Pool_free(Pool* pool, void* block) {
+    if (!block) return;
+
+    *(void**)block = pool->free_list;
+    pool->free_list = block;
+
+    pool->used--;
+    pool->frees++;
+}
+
+
+void Pool_print_stats(Pool* pool, const char* name) {
+    LOG_INFO("%s: %d/%d blocks of %d bytes in use, peak %d, %d allocations, %d frees",
+        name, pool->used, pool->chunks_size * pool->chunk_blocks, pool->block_size, pool->peak,
+        pool->allocations, pool->frees);
+}
+
+
+void Pool_destroy(Pool* pool) {
+    for (int i = 0; i < pool->chunks_size; i++) {
+        free(pool->chunks[i]);
+    }
+    free(pool->chunks);
+    free(pool);
+}
@@ -2,6 +2,7 @@
 
 #include <linalg.h>
 #include <math.h>
+#include <resources.h>
 #include <scene.h>
 #include <stdio.h>
 #include <systems/collision.h>
@@ -135,51 +136,258 @@ Intersection intersection_capsule_ray(Capsule capsule, Ray ray) {
 }
 
 
-Hit raycast(Ray ray, ColliderGroup group) {
-    Hit hit = {
-        .entity = NULL_ENTITY,
+Intersection intersection_heightfield_ray(HeightfieldShape heightfield, Ray ray) {
+    Intersection intersection = {
         .distance = INFINITY,
-        .point = zeros3(),
         .normal = zeros3()
     };
 
-    for (Entity i = 0; i < scene->components->entities; i++) {
-        ColliderComponent* collider = get_component(i, COMPONENT_COLLIDER);
-        if (!collider) continue;
+    // Distances along the ray are the same in the scaled local frame of the heightfield
+    Matrix3 rot = quaternion_to_rotation_matrix(heightfield.rotation);
+    Matrix3 inv_rot = transpose3(rot);
+    Vector3 inv_scale = vec3(1.0f / heightfield.scale.x, 1.0f / heightfield.scale.y, 1.0f / heightfield.scale.z);
+    Vector3 local_origin = prod3(inv_scale, matrix3_map(inv_rot, diff3(ray.origin, heightfield.center)));
+    Vector3 local_dir = prod3(inv_scale, matrix3_map(inv_rot, ray.direction));
 
-        if (!(collider->group & group)) {
-            continue;
-        }
+    Vector3 normal;
+    float distance = Heightfield_raycast(heightfield.heightfield, local_origin, local_dir, INFINITY, &normal);
+    if (distance == INFINITY) {
+        return intersection;
+    }
+
+    intersection.distance = distance;
+    intersection.point = sum3(ray.origin, mult3(distance, ray.direction));
+    intersection.normal = normalized3(matrix3_map(rot, prod3(inv_scale, normal)));
 
-        Intersection intersection = {
-            .distance = INFINITY
-        };
-
-        Shape shape = get_shape(i);
-
-        switch (collider->type) {
-            case COLLIDER_PLANE:
-                break;
-            case COLLIDER_SPHERE:
-                intersection = intersection_sphere_ray(shape.sphere, ray);
-                break;
-            case COLLIDER_CUBOID:
-                intersection = intersection_cuboid_ray(shape.cuboid, ray);
-                break;
-            case COLLIDER_CAPSULE:
-                intersection = intersection_capsule_ray(shape.capsule, ray);
-                break;
-            default:
-                LOG_ERROR("Unknown collider type: %d", collider->type);
+    return intersection;
+}
+
+
+Intersection intersection_mesh_ray(MeshShape mesh, Ray ray) {
+    Intersection intersection = {
+        .distance = INFINITY,
+        .normal = zeros3()
+    };
+
+    // Same as the heightfield, the triangles are in the scaled local frame of the mesh
+    Matrix3 rot = quaternion_to_rotation_matrix(mesh.rotation);
+    Matrix3 inv_rot = transpose3(rot);
+    Vector3 inv_scale = vec3(1.0f / mesh.scale.x, 1.0f / mesh.scale.y, 1.0f / mesh.scale.z);
+    Vector3 local_origin = prod3(inv_scale, matrix3_map(inv_rot, diff3(ray.origin, mesh.center)));
+    Vector3 local_dir = prod3(inv_scale, matrix3_map(inv_rot, ray.direction));
+
+    Vector3 normal;
+    float distance = BVH_raycast(resources.meshes[mesh.mesh_index].bvh, local_origin, local_dir, INFINITY, &normal);
+    if (distance == INFINITY) {
+        return intersection;
+    }
+
+    intersection.distance = distance;
+    intersection.point = sum3(ray.origin, mult3(distance, ray.direction));
+    intersection.normal = normalized3(matrix3_map(rot, prod3(inv_scale, normal)));
+
+    return intersection;
+}
+
+
+typedef struct {
+    Ray ray;
+    ColliderGroup group;
+    Hit hit;
+} RaycastQuery;
+
+
+static float raycast_entity(void* data, Entity i, float max_distance) {
+    RaycastQuery* query = data;
+
+    ColliderComponent* collider = get_component(i, COMPONENT_COLLIDER);
+    if (!collider || !(collider->group & query->group)) {
+        return max_distance;
+    }
+
+    Intersection intersection = {
+        .distance = INFINITY
+    };
+
+    Shape shape = collider->shape;
+
+    switch (collider->type) {
+        case COLLIDER_PLANE:
+            break;
+        case COLLIDER_SPHERE:
+            intersection = intersection_sphere_ray(shape.sphere, query->ray);
+            break;
+        case COLLIDER_CUBOID:
+            intersection = intersection_cuboid_ray(shape.cuboid, query->ray);
+            break;
+        case COLLIDER_CAPSULE:
+            intersection = intersection_capsule_ray(shape.capsule, query->ray);
+            break;
+        case COLLIDER_HEIGHTFIELD:
+            intersection = intersection_heightfield_ray(shape.heightfield, query->ray);
+            break;
+        case COLLIDER_MESH:
+            intersection = intersection_mesh_ray(shape.mesh, query->ray);
+            break;
+        default:
+            LOG_ERROR("Unknown collider type: %d", collider->type);
+    }
+
+    if (intersection.distance < query->hit.distance) {
+        query->hit.entity = i;
+        query->hit.distance = intersection.distance;
+        query->hit.point = intersection.point;
+        query->hit.normal = intersection.normal;
+    }
+
+    return query->hit.distance;
+}
+
+
+Hit raycast(Ray ray, ColliderGroup group) {
+    RaycastQuery query = {
+        .ray = ray,
+        .group = group,
+        .hit = {
+            .entity = NULL_ENTITY,
+            .distance = INFINITY,
+            .point = zeros3(),
+            .normal = zeros3()
         }
+    };
+
+    // The trees and the cached shapes hold the colliders as of the last collision update.
+    // The static hit limits the search among moving colliders.
+    AABBTree_raycast(scene->broadphase->static_tree, ray.origin, ray.direction, INFINITY, raycast_entity, &query);
+    AABBTree_raycast(scene->broadphase->tree, ray.origin, ray.direction, query.hit.distance, raycast_entity, &query);
+
+    return query.hit;
+}
+
+
+typedef struct {
+    Sphere sphere;
+    Vector3 motion;
+    Entity entity;
+    ColliderGroup group;
+    Hit hit;
+} SweepQuery;
+
+
+static Intersection sweep_sphere_cuboid(Sphere sphere, Vector3 motion, Cuboid cuboid) {
+    // The cuboid grown by the radius, which is conservative around edges and corners
+    cuboid.half_extents = sum3(cuboid.half_extents, vec3(sphere.radius, sphere.radius, sphere.radius));
+    Ray ray = { .origin = sphere.center, .direction = motion };
+    Intersection intersection = intersection_cuboid_ray(cuboid, ray);
+
+    // Leaving the cuboid or starting inside it is left to the narrowphase
+    if (dot3(intersection.normal, motion) >= 0.0f || intersection.distance < 0.0f) {
+        intersection.distance = INFINITY;
+    }
+    return intersection;
+}
+
+
+static Intersection sweep_sphere_shape(Sphere sphere, Vector3 motion, ColliderType type, Shape shape) {
+    Intersection intersection = {
+        .distance = INFINITY,
+        .normal = zeros3()
+    };
 
-        if (intersection.distance < hit.distance) {
-            hit.entity = i;
-            hit.distance = intersection.distance;
-            hit.point = intersection.point;
-            hit.normal = intersection.normal;
+    switch (type) {
+        case COLLIDER_PLANE: {
+            float dist = dot3(sphere.center, shape.plane.normal) - shape.plane.offset;
+            float speed = dot3(motion, shape.plane.normal);
+            if (dist >= sphere.radius && speed < 0.0f) {
+                intersection.distance = (sphere.radius - dist) / speed;
+                intersection.normal = shape.plane.normal;
+            }
+            break;
+        }
+        case COLLIDER_SPHERE: {
+            Sphere sum = { .center = shape.sphere.center, .radius = shape.sphere.radius + sphere.radius };
+            Ray ray = { .origin = sphere.center, .direction = motion };
+            intersection = intersection_sphere_ray(sum, ray);
+            if (intersection.distance < 0.0f || dot3(intersection.normal, motion) >= 0.0f) {
+                intersection.distance = INFINITY;
+            }
+            break;
+        }
+        case COLLIDER_CUBOID:
+            intersection = sweep_sphere_cuboid(sphere, motion, shape.cuboid);
+            break;
+        case COLLIDER_AABB: {
+            Cuboid cuboid = {
+                .center = shape.aabb.center,
+                .half_extents = shape.aabb.half_extents,
+                .rotation = quaternion_id()
+            };
+            intersection = sweep_sphere_cuboid(sphere, motion, cuboid);
+            break;
         }
+        default:
+            // Static capsules are not swept against
+            break;
     }
 
-    return hit;
+    return intersection;
+}
+
+
+static bool sweep_entity(void* data, Entity i) {
+    SweepQuery* query = data;
+    if (i == query->entity) {
+        return true;
+    }
+
+    ColliderComponent* collider = get_component(i, COMPONENT_COLLIDER);
+    if (!collider || collider->sensor || !groups_collide(query->group, collider->group)) {
+        return true;
+    }
+
+    Intersection intersection = sweep_sphere_shape(query->sphere, query->motion, collider->type, collider->shape);
+    if (intersection.distance < query->hit.distance) {
+        query->hit.entity = i;
+        query->hit.distance = intersection.distance;
+        query->hit.normal = intersection.normal;
+        query->hit.point = sum3(query->sphere.center, mult3(intersection.distance, query->motion));
+    }
+
+    return true;
+}
+
+
+Hit sweep_sphere(Sphere sphere, Vector3 motion, Entity entity) {
+    ColliderComponent* collider = get_component(entity, COMPONENT_COLLIDER);
+    SweepQuery query = {
+        .sphere = sphere,
+        .motion = motion,
+        .entity = entity,
+        .group = collider ? collider->group : GROUP_NONE,
+        .hit = {
+            .entity = NULL_ENTITY,
+            .distance = 1.0f,
+            .point = zeros3(),
+            .normal = zeros3()
+        }
+    };
+
+    // Only static colliders are swept against, moving ones are left to the narrowphase
+    Vector3 end = sum3(sphere.center, motion);
+    Vector3 min = {
+        fminf(sphere.center.x, end.x) - sphere.radius,
+        fminf(sphere.center.y, end.y) - sphere.radius,
+        fminf(sphere.center.z, end.z) - sphere.radius
+    };
+    Vector3 max = {
+        fmaxf(sphere.center.x, end.x) + sphere.radius,
+        fmaxf(sphere.center.y, end.y) + sphere.radius,
+        fmaxf(sphere.center.z, end.z) + sphere.radius
+    };
+    AABBTree_query(scene->broadphase->static_tree, min, max, sweep_entity, &query);
+
+    if (query.hit.entity == NULL_ENTITY) {
+        query.hit.distance = INFINITY;
+    }
+    return query.hit;
 }
@@ -772,9 +772,11 @@ void add_light(Entity entity) {
 
 
 void render_shadow_maps(SDL_GPUCommandBuffer* command_buffer) {
-	for (Entity i = 0; i < scene->components->entities; i++) {
+	// Same query as draw_entities, so shadow map layers follow the order of the light data
+	ComponentArray* lights = query_entities(COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_LIGHT));
+	for (int k = 0; k < lights->size; k++) {
+		Entity i = lights->entities[k];
 		LightComponent* light = get_component(i, COMPONENT_LIGHT);
-		if (!light) continue;
 
 		ShadowUniformData shadow_uniform_data = {
 			.projection_view_matrix = transpose4(light->shadow_map.projection_view_matrix),
@@ -809,9 +811,8 @@ void render_shadow_maps(SDL_GPUCommandBuffer* command_buffer) {
 	}
 
 	int layer = 0;
-	for (Entity i = 0; i < scene->components->entities; i++) {
-		LightComponent* light = get_component(i, COMPONENT_LIGHT);
-		if (!light) continue;
+	for (int k = 0; k < lights->size; k++) {
+		LightComponent* light = get_component(lights->entities[k], COMPONENT_LIGHT);
 
 		SDL_GPUCopyPass* copy_pass = SDL_BeginGPUCopyPass(command_buffer);
 		SDL_CopyGPUTextureToTexture(
@@ -1,5 +1,6 @@
 #include <render.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <SDL3_image/SDL_image.h>
 
 #include "util.h"
@@ -333,6 +334,15 @@ MeshData load_mesh(String path) {
 		transfer_data[i2].tangent = normalized3(sum3(transfer_data[i2].tangent, tangent));
 	}
 
+	// Collision triangles share positions across seams in the texture coordinates and normals
+	int* triangles = malloc(sizeof(int) * indices->size);
+	for (int i = 0; i < indices->size; i++) {
+		VertexIndices vi = *(VertexIndices*)ArrayList_get(unique_vertices, index_data[i]);
+		triangles[i] = vi.position_idx;
+	}
+	mesh_data.bvh = BVH_create(positions->data, positions->size, triangles, indices->size);
+	free(triangles);
+
 	ArrayList_destroy(unique_vertices);
 	ArrayList_destroy(positions);
 	ArrayList_destroy(normals);
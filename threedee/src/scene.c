@@ -54,9 +54,8 @@ Entity create_lamp(Vector3 position) {
 
 Entity create_wall(Vector3 position, float width, float depth, int windows) {
     Entity i = create_entity();
-    TransformComponent* trans = TransformComponent_add(i, position);
-    trans->position.y = position.y - 1.0f;
-    trans->scale = vec3(width, 1.0f, depth);
+    TransformComponent_add(i, vec3(position.x, position.y - 1.0f, position.z));
+    set_scale(i, vec3(width, 1.0f, depth));
     MeshComponent_add(i, "cube", "tiles", "glass");
     ColliderComponent_add(i, (ColliderParameters) { .type = COLLIDER_AABB, .group = GROUP_WALLS });
 
@@ -70,21 +69,20 @@ Entity create_wall(Vector3 position, float width, float depth, int windows) {
         Entity window = create_entity();
         if (width > depth) {
             float x = position.x - 0.5f * width + 0.5f * segment_width + j * (segment_width + window_width);
-            trans = TransformComponent_add(window, vec3(x, position.y, position.z));
-            trans->scale = vec3(segment_width, 1.0f, depth);
+            TransformComponent_add(window, vec3(x, position.y, position.z));
+            set_scale(window, vec3(segment_width, 1.0f, depth));
         } else {
             float z = position.z - 0.5f * depth + 0.5f * segment_depth + j * (segment_depth + window_width);
-            trans = TransformComponent_add(window, vec3(position.x, position.y, z));
-            trans->scale = vec3(width, 1.0f, segment_depth);
+            TransformComponent_add(window, vec3(position.x, position.y, z));
+            set_scale(window, vec3(width, 1.0f, segment_depth));
         }
         MeshComponent_add(window, "cube", "tiles", "glass");
         ColliderComponent_add(window, (ColliderParameters) { .type = COLLIDER_AABB, .group = GROUP_WALLS });
     }
 
     i = create_entity();
-    trans = TransformComponent_add(i, position);
-    trans->position.y = position.y + 1.0f;
-    trans->scale = vec3(width, 1.0f, depth);
+    TransformComponent_add(i, vec3(position.x, position.y + 1.0f, position.z));
+    set_scale(i, vec3(width, 1.0f, depth));
     MeshComponent_add(i, "cube", "tiles", "glass");
     ColliderComponent_add(i, (ColliderParameters) { .type = COLLIDER_AABB, .group = GROUP_WALLS });
 
@@ -98,21 +96,23 @@ void create_scene() {
 
     scene = malloc(sizeof(Scene));
     scene->components = ComponentData_create();
+    scene->commands = CommandBuffer_create();
+    scene->broadphase = Broadphase_create(BROADPHASE_TREE);
+    scene->narrowphase = Narrowphase_create();
+    scene->contacts = ContactCache_create();
     scene->menu_camera = create_menu_camera();
     scene->player = create_player(vec3(0.0f, 2.0f, 0.0f));
     TransformComponent* trans = get_component(scene->player, COMPONENT_TRANSFORM);
-    scene->camera = trans->children->head->value;
+    scene->camera = trans->first_child;
 
     Entity i = create_entity();
-    trans = TransformComponent_add(i, vec3(0.0f, -2.1f, 0.0f));
-    trans->scale.x = 100.0f;
-    trans->scale.z = 100.0f;
+    TransformComponent_add(i, vec3(0.0f, -2.1f, 0.0f));
+    set_scale(i, vec3(100.0f, 1.0f, 100.0f));
     MeshComponent_add(i, "cube", "gravel", "concrete");
 
     i = create_entity();
-    trans = TransformComponent_add(i, vec3(0.0f, -2.0f, 0.0f));
-    trans->scale.x = 10.0f;
-    trans->scale.z = 10.0f;
+    TransformComponent_add(i, vec3(0.0f, -2.0f, 0.0f));
+    set_scale(i, vec3(10.0f, 1.0f, 10.0f));
     MeshComponent_add(i, "cube", "tiles", "concrete");
     ColliderComponent_add(i, (ColliderParameters) { .type = COLLIDER_AABB, .group = GROUP_WALLS });
 
@@ -142,8 +142,8 @@ void create_scene() {
 
     for (int j = 0; j < 1; j++) {
         i = create_entity();
-        TransformComponent* transform = TransformComponent_add(i, vec3((float) j, 1.0f, 0.0f));
-        transform->scale = vec3(0.05f, 0.05f, 0.05f);
+        TransformComponent_add(i, vec3((float) j, 1.0f, 0.0f));
+        set_scale(i, vec3(0.05f, 0.05f, 0.05f));
         MeshComponent_add(i, "teapot", "tiles", "hidden")->visibility = LIGHT_UV;
         RigidBodyComponent* rigid_body = RigidBodyComponent_add(i, 1.0f);
         // rigid_body->angular_velocity = vec3(0.0f, 1.0f, 0.0f);
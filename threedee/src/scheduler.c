@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scheduler.h"
+#include "util.h"
+
+
+typedef struct {
+    System* system;
+    CommandBuffer* commands;
+    float time_step;
+} SystemJob;
+
+
+Scheduler* Scheduler_create(ThreadPool* pool) {
+    Scheduler* scheduler = malloc(sizeof(Scheduler));
+    scheduler->size = 0;
+    scheduler->stages_size = 0;
+    scheduler->pool = pool;
+    return scheduler;
+}
+
+
+static bool conflicts(System* a, System* b) {
+    if (a->main_thread && b->main_thread) {
+        return true;
+    }
+    return (a->writes & (b->reads | b->writes)) || (b->writes & a->reads);
+}
+
+
+void Scheduler_add(Scheduler* scheduler, System system) {
+    if (scheduler->size == MAX_SYSTEMS) {
+        LOG_ERROR("Too many systems: %s", system.name);
+        return;
+    }
+
+    // A system has to run after every earlier system it conflicts with
+    int stage = 0;
+    for (int i = 0; i < scheduler->size; i++) {
+        if (conflicts(&scheduler->systems[i], &system)) {
+            stage = maxi(stage, scheduler->stages[i] + 1);
+        }
+    }
+
+    scheduler->systems[scheduler->size] = system;
+    scheduler->stages[scheduler->size] = stage;
+    scheduler->commands[scheduler->size] = CommandBuffer_create();
+    scheduler->size++;
+    scheduler->stages_size = maxi(scheduler->stages_size, stage + 1);
+
+    LOG_DEBUG("System %s in stage %d", system.name, stage);
+}
+
+
+static void run_system(void* data) {
+    SystemJob* job = data;
+    job->system->update(job->time_step, job->commands);
+}
+
+
+void Scheduler_run(Scheduler* scheduler, float time_step) {
+    SystemJob jobs[MAX_SYSTEMS];
+
+    for (int stage = 0; stage < scheduler->stages_size; stage++) {
+        int pending = 0;
+
+        for (int i = 0; i < scheduler->size; i++) {
+            System* system = &scheduler->systems[i];
+            if (scheduler->stages[i] != stage || system->main_thread) continue;
+
+            jobs[i] = (SystemJob) { .system = system, .commands = scheduler->commands[i], .time_step = time_step };
+            ThreadPool_submit(scheduler->pool, run_system, &jobs[i], &pending);
+        }
+
+        for (int i = 0; i < scheduler->size; i++) {
+            System* system = &scheduler->systems[i];
+            if (scheduler->stages[i] == stage && system->main_thread) {
+                system->update(time_step, scheduler->commands[i]);
+            }
+        }
+
+        ThreadPool_wait(scheduler->pool, &pending);
+    }
+}
+
+
+void Scheduler_execute_commands(Scheduler* scheduler) {
+    // Each system records into its own buffer, so the playback order does not depend on timing
+    for (int i = 0; i < scheduler->size; i++) {
+        CommandBuffer_execute(scheduler->commands[i]);
+    }
+}
+
+
+void Scheduler_destroy(Scheduler* scheduler) {
+    for (int i = 0; i < scheduler->size; i++) {
+        CommandBuffer_destroy(scheduler->commands[i]);
+    }
+    free(scheduler);
+}
@@ -82,9 +82,10 @@ void stop_loop(int entity) {
 
 
 void play_sounds(int camera) {
-    for (int i = 0; i < scene->components->entities; i++) {
-        SoundComponent* scomp = SoundComponent_get(i);
-        if (!scomp) continue;
+    ComponentArray* sounds = scene->components->sound;
+    for (int k = 0; k < sounds->size; k++) {
+        Entity i = sounds->entities[k];
+        SoundComponent* scomp = (SoundComponent*)sounds->data + k;
 
         float dist = norm2(diff2(get_xy(i), get_xy(camera)));
 
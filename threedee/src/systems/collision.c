@@ -2,16 +2,14 @@
 
 #include <render.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "scene.h"
 #include "util.h"
-
-
-static const unsigned int COLLISION_MASKS[] = {
-    [GROUP_WALLS] = 0,
-    [GROUP_PLAYERS] = GROUP_WALLS,
-    [GROUP_PROPS] = GROUP_WALLS | GROUP_PLAYERS | GROUP_PROPS
-};
+#include "bvh.h"
+#include "heightfield.h"
+#include "resources.h"
 
 
 Penetration penetration_sphere_sphere(Sphere sphere1, Sphere sphere2) {
@@ -50,6 +48,57 @@ Penetration penetration_sphere_plane(Sphere sphere, Plane plane) {
 }
 
 
+static float manifold_area(Vector3 p0, Vector3 p1, Vector3 p2, Vector3 p3) {
+    // Largest cross product of two segments between the points, without knowing their order
+    float area = norm3(cross(diff3(p0, p1), diff3(p2, p3)));
+    area = fmaxf(area, norm3(cross(diff3(p0, p2), diff3(p1, p3))));
+    return fmaxf(area, norm3(cross(diff3(p0, p3), diff3(p1, p2))));
+}
+
+
+static int reduce_contacts(ContactPoint* contacts, int size) {
+    // Keep the deepest point, then add the points that span the largest area with it one by one
+    if (size <= MAX_CONTACT_POINTS) {
+        return size;
+    }
+
+    int chosen[MAX_CONTACT_POINTS] = { 0 };
+    for (int i = 1; i < size; i++) {
+        if (contacts[i].depth > contacts[chosen[0]].depth) {
+            chosen[0] = i;
+        }
+    }
+
+    Vector3 p0 = contacts[chosen[0]].point;
+    for (int k = 1; k < MAX_CONTACT_POINTS; k++) {
+        float max_score = -1.0f;
+        for (int i = 0; i < size; i++) {
+            Vector3 p = contacts[i].point;
+            float score;
+            if (k == 1) {
+                score = norm3(diff3(p, p0));
+            } else if (k == 2) {
+                score = norm3(cross(diff3(contacts[chosen[1]].point, p0), diff3(p, p0)));
+            } else {
+                score = manifold_area(p0, contacts[chosen[1]].point, contacts[chosen[2]].point, p);
+            }
+            if (score > max_score) {
+                max_score = score;
+                chosen[k] = i;
+            }
+        }
+    }
+
+    ContactPoint reduced[MAX_CONTACT_POINTS];
+    for (int k = 0; k < MAX_CONTACT_POINTS; k++) {
+        reduced[k] = contacts[chosen[k]];
+    }
+    memcpy(contacts, reduced, sizeof(reduced));
+
+    return MAX_CONTACT_POINTS;
+}
+
+
 Penetration penetration_cuboid_plane(Cuboid cuboid, Plane plane) {
     Matrix3 rot = quaternion_to_rotation_matrix(cuboid.rotation);
 
@@ -69,6 +118,7 @@ Penetration penetration_cuboid_plane(Cuboid cuboid, Plane plane) {
         .contact_point = zeros3(),
     };
 
+    ContactPoint contacts[8];
     float min_dist = 0.0f;
     int penetration_count = 0;
     for (int i = 0; i < 8; i++) {
@@ -76,8 +126,13 @@ Penetration penetration_cuboid_plane(Cuboid cuboid, Plane plane) {
         float dist = dot3(v, plane.normal) - plane.offset;
         if (dist < 0.0f) {
             min_dist = fminf(min_dist, dist);
-            penetration_count++;
             penetration.contact_point = sum3(penetration.contact_point, v);
+            contacts[penetration_count] = (ContactPoint) {
+                .point = diff3(v, mult3(0.5f * dist, plane.normal)),
+                .depth = -dist,
+                .feature = i
+            };
+            penetration_count++;
         }
     }
 
@@ -85,6 +140,8 @@ Penetration penetration_cuboid_plane(Cuboid cuboid, Plane plane) {
         penetration.valid = true;
         penetration.contact_point = mult3(1.0f / (float)penetration_count, penetration.contact_point);
         penetration.overlap = mult3(-min_dist, plane.normal);
+        penetration.contacts_size = reduce_contacts(contacts, penetration_count);
+        memcpy(penetration.contacts, contacts, sizeof(ContactPoint) * penetration.contacts_size);
     }
 
     return penetration;
@@ -115,7 +172,7 @@ Vector3 intersect(Vector3 p1, Vector3 p2, Plane plane) {
 }
 
 
-void clip_polygon(PolygonShape* polygon, Plane plane) {
+void clip_polygon(PolygonShape* polygon, Plane plane, int plane_id) {
     // Sutherland-Hodgman algorithm for clipping a polygon against a plane
     if (polygon->size == 0) {
         return;
@@ -123,33 +180,38 @@ void clip_polygon(PolygonShape* polygon, Plane plane) {
 
     #define inside(p) (dot3(p, plane.normal) <= plane.offset)
 
-    // The clipped polygon will have at most 1 extra point
+    // Each plane adds at most one point, so a quad clipped by four planes fits in the buffer
     PolygonShape clipped = {
-        .points = malloc(sizeof(Vector3) * (polygon->size + 4)),
         .size = 0
     };
 
     Vector3 prev = polygon->points[polygon->size - 1];
+    int prev_feature = polygon->features[polygon->size - 1];
     for (int i = 0; i < polygon->size; i++) {
         Vector3 curr = polygon->points[i];
+        int curr_feature = polygon->features[i];
+        // Intersections are named after the clipping plane and the edge they cut
+        int edge_feature = ((plane_id + 1) << 4) | ((prev_feature & 3) << 2) | (curr_feature & 3);
         if (inside(curr)) {
             if (!inside(prev)) {
-                clipped.points[clipped.size++] = intersect(prev, curr, plane);
+                clipped.points[clipped.size] = intersect(prev, curr, plane);
+                clipped.features[clipped.size++] = edge_feature;
             }
-            clipped.points[clipped.size++] = curr;
+            clipped.points[clipped.size] = curr;
+            clipped.features[clipped.size++] = curr_feature;
         } else if (inside(prev)) {
-            clipped.points[clipped.size++] = intersect(prev, curr, plane);
+            clipped.points[clipped.size] = intersect(prev, curr, plane);
+            clipped.features[clipped.size++] = edge_feature;
         }
         prev = curr;
+        prev_feature = curr_feature;
     }
-    free(polygon->points);
-    polygon->points = clipped.points;
-    polygon->size = clipped.size;
+    *polygon = clipped;
     #undef inside
 }
 
 
-Vector3 contact_point_cuboid_cuboid(Cuboid cuboid1, Cuboid cuboid2, Vector3 overlap_axis) {
+int contact_points_cuboid_cuboid(Cuboid cuboid1, Cuboid cuboid2, Vector3 overlap_axis, ContactPoint* contacts) {
     Matrix3 rot1 = quaternion_to_rotation_matrix(cuboid1.rotation);
     Matrix3 rot2 = quaternion_to_rotation_matrix(cuboid2.rotation);
 
@@ -161,6 +223,7 @@ Vector3 contact_point_cuboid_cuboid(Cuboid cuboid1, Cuboid cuboid2, Vector3 over
     }
     int ref_axis = abs_argmax(dot_refs, 6);
     float ref_sign = sign(dot_refs[ref_axis]);
+    int ref_feature = 2 * ref_axis + (ref_sign > 0.0f);
 
     Cuboid ref_cuboid = cuboid1;
     Cuboid inc_cuboid = cuboid2;
@@ -187,19 +250,6 @@ Vector3 contact_point_cuboid_cuboid(Cuboid cuboid1, Cuboid cuboid2, Vector3 over
         (ref_axis + 2) % 3
     };
 
-    Vector3 ref_face_points[4];
-    int n = 0;
-    for (int dx = -1; dx <= 1; dx += 2) {
-        for (int dy = -1; dy <= 1; dy += 2) {
-            Vector3 offset = sum3(
-                mult3(dx * vec3_get(ref_cuboid.half_extents, ref_face_axes[0]), matrix3_column(ref_rot, ref_face_axes[0])),
-                mult3(dy * vec3_get(ref_cuboid.half_extents, ref_face_axes[1]), matrix3_column(ref_rot, ref_face_axes[1]))
-            );
-            ref_face_points[n] = sum3(ref_face_center, offset);
-            n++;
-        }
-    }
-
     float dot_incs[3];
     for (int i = 0; i < 3; i++) {
         dot_incs[i] = dot3(ref_face_normal, matrix3_column(inc_rot, i));
@@ -217,16 +267,18 @@ Vector3 contact_point_cuboid_cuboid(Cuboid cuboid1, Cuboid cuboid2, Vector3 over
         (inc_axis + 2) % 3
     };
 
-    Vector3 inc_face_points[4];
-    n = 0;
-    for (int dx = -1; dx <= 1; dx += 2) {
-        for (int dy = -1; dy <= 1; dy += 2) {
-            Vector3 offset = sum3(
-                mult3(dx * vec3_get(inc_cuboid.half_extents, inc_face_axes[0]), matrix3_column(inc_rot, inc_face_axes[0])),
-                mult3(dy * vec3_get(inc_cuboid.half_extents, inc_face_axes[1]), matrix3_column(inc_rot, inc_face_axes[1]))
-            );
-            inc_face_points[n++] = sum3(inc_face_center, offset);
-        }
+    // The incident face goes around its corners in order for the clipping
+    const float corners[4][2] = { { -1, -1 }, { -1, 1 }, { 1, 1 }, { 1, -1 } };
+    PolygonShape clipped = {
+        .size = 4
+    };
+    for (int i = 0; i < 4; i++) {
+        Vector3 offset = sum3(
+            mult3(corners[i][0] * vec3_get(inc_cuboid.half_extents, inc_face_axes[0]), matrix3_column(inc_rot, inc_face_axes[0])),
+            mult3(corners[i][1] * vec3_get(inc_cuboid.half_extents, inc_face_axes[1]), matrix3_column(inc_rot, inc_face_axes[1]))
+        );
+        clipped.points[i] = sum3(inc_face_center, offset);
+        clipped.features[i] = i;
     }
 
     Vector3 ref_u = matrix3_column(ref_rot, ref_face_axes[0]);
@@ -234,12 +286,6 @@ Vector3 contact_point_cuboid_cuboid(Cuboid cuboid1, Cuboid cuboid2, Vector3 over
     float hu = vec3_get(ref_cuboid.half_extents, ref_face_axes[0]);
     float hv = vec3_get(ref_cuboid.half_extents, ref_face_axes[1]);
 
-    PolygonShape clipped = {
-        .points = malloc(sizeof(Vector3) * 4),
-        .size = 4
-    };
-    memcpy(clipped.points, inc_face_points, sizeof(Vector3) * 4);
-
     Plane planes[4] = {
         { ref_u, dot3(ref_u, sum3(ref_face_center, mult3(hu, ref_u))) },
         { neg3(ref_u), dot3(neg3(ref_u), diff3(ref_face_center, mult3(hu, ref_u))) },
@@ -248,119 +294,142 @@ Vector3 contact_point_cuboid_cuboid(Cuboid cuboid1, Cuboid cuboid2, Vector3 over
     };
 
     for (int i = 0; i < 4; i++) {
-        clip_polygon(&clipped, planes[i]);
+        clip_polygon(&clipped, planes[i], i);
         if (clipped.size == 0) {
             break;
         }
     }
 
+    // Keep the points below the reference face, halfway between the two surfaces
     Vector3 contact_normal = normalized3(ref_face_normal);
-    Vector3 avg_contact_point = zeros3();
-    int contact_count = 0;
+    ContactPoint candidates[MAX_POLYGON_POINTS];
+    int size = 0;
     for (int i = 0; i < clipped.size; i++) {
         Vector3 p = clipped.points[i];
         float depth = dot3(diff3(p, ref_face_center), contact_normal);
-        if (depth > 1e-4f) {
+        if (depth > CONTACT_THRESHOLD) {
             continue;
         }
 
-        Vector3 contact_point = diff3(p, mult3(depth, contact_normal));
-        avg_contact_point = sum3(avg_contact_point, contact_point);
-        contact_count++;
+        candidates[size++] = (ContactPoint) {
+            .point = diff3(p, mult3(0.5f * depth, contact_normal)),
+            .depth = fmaxf(-depth, 0.0f),
+            .feature = (ref_feature << 7) | clipped.features[i]
+        };
+    }
+
+    size = reduce_contacts(candidates, size);
+    memcpy(contacts, candidates, sizeof(ContactPoint) * size);
+    return size;
+}
+
+
+typedef struct {
+    Cuboid cuboid1;
+    Cuboid cuboid2;
+    Matrix3 rot1;
+    Matrix3 rot2;
+    Matrix3 rot;
+    Matrix3 abs_rot;
+    Vector3 t;
+    Vector3 t_world;
+} SatFrame;
+
+
+// Overlap of the cuboids along separating axis candidate k, which is negative if the axis separates them
+// and infinite if the axis is degenerate. Axes 0-2 belong to cuboid 1, 3-5 to cuboid 2 and the rest are
+// the cross products of their edges.
+static float overlap_on_axis(const SatFrame* frame, int k, Vector3* axis) {
+    const float eps = 1e-4f;
+
+    if (k < 3) {
+        float ra = vec3_get(frame->cuboid1.half_extents, k);
+        float rb = dot3(frame->cuboid2.half_extents, matrix3_row(frame->abs_rot, k));
+        *axis = matrix3_column(frame->rot1, k);
+        return ra + rb - fabsf(vec3_get(frame->t, k));
+    }
+
+    if (k < 6) {
+        int i = k - 3;
+        float ra = dot3(frame->cuboid1.half_extents, matrix3_column(frame->abs_rot, i));
+        float rb = vec3_get(frame->cuboid2.half_extents, i);
+        *axis = matrix3_column(frame->rot2, i);
+        return ra + rb - fabsf(dot3(frame->t, matrix3_column(frame->rot, i)));
     }
-    if (contact_count > 0) {
-        avg_contact_point = div3((float)contact_count, avg_contact_point);
+
+    int i = (k - 6) / 3;
+    int j = (k - 6) % 3;
+    Vector3 edge_axis = cross(matrix3_column(frame->rot1, i), matrix3_column(frame->rot2, j));
+    float axis_norm = norm3(edge_axis);
+    if (axis_norm < eps) return INFINITY;
+    edge_axis = mult3(1.0f / axis_norm, edge_axis);
+
+    float ra = 0.0f;
+    float rb = 0.0f;
+
+    for (int l = 0; l < 3; l++) {
+        ra += fabsf(vec3_get(frame->cuboid1.half_extents, l) * dot3(edge_axis, matrix3_column(frame->rot1, l)));
+        rb += fabsf(vec3_get(frame->cuboid2.half_extents, l) * dot3(edge_axis, matrix3_column(frame->rot2, l)));
     }
 
-    free(clipped.points);
-    return avg_contact_point;
+    *axis = edge_axis;
+    return ra + rb - fabsf(dot3(frame->t_world, edge_axis));
 }
 
 
-Penetration penetration_cuboid_cuboid(Cuboid cuboid1, Cuboid cuboid2) {
+// If axis is given, it is tested first and replaced by the separating axis, or the axis of least overlap
+Penetration penetration_cuboid_cuboid(Cuboid cuboid1, Cuboid cuboid2, int* axis) {
     const float eps = 1e-4f;
 
-    Matrix3 rot1 = quaternion_to_rotation_matrix(cuboid1.rotation);
-    Matrix3 inv_rot1 = transpose3(rot1);
-    Matrix3 rot2 = quaternion_to_rotation_matrix(cuboid2.rotation);
-    Vector3 t_world = diff3(cuboid2.center, cuboid1.center);
+    SatFrame frame = {
+        .cuboid1 = cuboid1,
+        .cuboid2 = cuboid2
+    };
+    frame.rot1 = quaternion_to_rotation_matrix(cuboid1.rotation);
+    Matrix3 inv_rot1 = transpose3(frame.rot1);
+    frame.rot2 = quaternion_to_rotation_matrix(cuboid2.rotation);
+    frame.t_world = diff3(cuboid2.center, cuboid1.center);
+    Vector3 t_world = frame.t_world;
 
     // Cuboid 2 rotation in cuboid 1 local frame
-    Matrix3 rot = matrix3_mult(inv_rot1, rot2);
+    frame.rot = matrix3_mult(inv_rot1, frame.rot2);
 
     // Translation vector in cuboid 1 local frame
-    Vector3 t = matrix3_map(inv_rot1, t_world);
+    frame.t = matrix3_map(inv_rot1, t_world);
 
     // Compute common subexpression
-    Matrix3 abs_rot = matrix3_add_scalar(matrix3_abs(rot), eps);
+    frame.abs_rot = matrix3_add_scalar(matrix3_abs(frame.rot), eps);
 
     Penetration penetration = {
         .valid = false
     };
 
-    float min_overlap = INFINITY;
-    Vector3 overlap_axis = zeros3();
-
-    // Test axes L = A0, A1, A2 (cuboid 1 local axes)
-    for (int i = 0; i < 3; i++) {
-        float ra = vec3_get(cuboid1.half_extents, i);
-        float rb = dot3(cuboid2.half_extents, matrix3_row(abs_rot, i));
-
-        float overlap = ra + rb - fabsf(vec3_get(t, i));
-        if (overlap < 0.0f) {
-            return penetration;
-        }
+    Vector3 candidate;
 
-        if (overlap < min_overlap) {
-            min_overlap = overlap;
-            overlap_axis = matrix3_column(rot1, i);
-        }
+    // Bodies that were apart last tick usually still are, along the same axis
+    if (axis && *axis >= 0 && overlap_on_axis(&frame, *axis, &candidate) < 0.0f) {
+        return penetration;
     }
 
-    // Test axes L = B0, B1, B2 (cuboid 2 local axes)
-    for (int i = 0; i < 3; i++) {
-        float ra = dot3(cuboid1.half_extents, matrix3_row(abs_rot, i));
-        float rb = vec3_get(cuboid2.half_extents, i);
+    float min_overlap = INFINITY;
+    Vector3 overlap_axis = zeros3();
+    int feature = 0;
 
-        float overlap = ra + rb - fabsf(dot3(t, matrix3_column(rot, i)));
+    for (int k = 0; k < 15; k++) {
+        float overlap = overlap_on_axis(&frame, k, &candidate);
         if (overlap < 0.0f) {
+            if (axis) *axis = k;
             return penetration;
         }
 
         if (overlap < min_overlap) {
             min_overlap = overlap;
-            overlap_axis = matrix3_column(rot2, i);
+            overlap_axis = candidate;
+            feature = k;
         }
     }
 
-    // Test axes L = A0 x B0, ..., A2 x B2
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            Vector3 axis = cross(matrix3_column(rot1, i), matrix3_column(rot2, j));
-            float axis_norm = norm3(axis);
-            if (axis_norm < eps) continue;
-            axis = mult3(1.0f / axis_norm, axis);
-
-            float ra = 0.0f;
-            float rb = 0.0f;
-
-            for (int k = 0; k < 3; k++) {
-                ra += fabsf(vec3_get(cuboid1.half_extents, k) * dot3(axis, matrix3_row(rot1, k)));
-                rb += fabsf(vec3_get(cuboid2.half_extents, k) * dot3(axis, matrix3_row(rot2, k)));
-            }
-
-            float dist = fabsf(dot3(t, axis));
-            float overlap = ra + rb - dist;
-            if (overlap < 0.0f) {
-                return penetration;
-            }
-
-            if (overlap < min_overlap) {
-                min_overlap = overlap;
-                overlap_axis = axis;
-            }
-        }
-    }
+    if (axis) *axis = feature;
 
     if (dot3(t_world, overlap_axis) > 0.0f) {
         overlap_axis = mult3(-1.0f, overlap_axis);
@@ -368,7 +437,18 @@ Penetration penetration_cuboid_cuboid(Cuboid cuboid1, Cuboid cuboid2) {
 
     penetration.valid = true;
     penetration.overlap = mult3(min_overlap, overlap_axis);
-    penetration.contact_point = contact_point_cuboid_cuboid(cuboid1, cuboid2, overlap_axis);
+    penetration.feature = feature;
+    penetration.contacts_size = contact_points_cuboid_cuboid(cuboid1, cuboid2, overlap_axis, penetration.contacts);
+
+    // Fall back to halfway between the centers if clipping leaves no points
+    penetration.contact_point = sum3(cuboid1.center, mult3(0.5f, t_world));
+    if (penetration.contacts_size > 0) {
+        penetration.contact_point = zeros3();
+        for (int i = 0; i < penetration.contacts_size; i++) {
+            penetration.contact_point = sum3(penetration.contact_point, penetration.contacts[i].point);
+        }
+        penetration.contact_point = div3((float)penetration.contacts_size, penetration.contact_point);
+    }
 
     return penetration;
 }
@@ -431,68 +511,14 @@ Penetration penetration_sphere_aabb(Sphere sphere, AABB aabb) {
 }
 
 
-Vector3 contact_point_obb_aabb(Cuboid obb, AABB aabb, Vector3 normal) {
-    Matrix3 rot_obb = quaternion_to_rotation_matrix(obb.rotation);
-    Vector3 contact_point = zeros3();
-    float max_penetration = -INFINITY;
-
-    // Compute all 8 corners of the OBB
-    for (int dx = -1; dx <= 1; dx += 2) {
-        for (int dy = -1; dy <= 1; dy += 2) {
-            for (int dz = -1; dz <= 1; dz += 2) {
-                Vector3 offset = sum3(
-                    mult3(dx * obb.half_extents.x, matrix3_column(rot_obb, 0)),
-                    sum3(
-                        mult3(dy * obb.half_extents.y, matrix3_column(rot_obb, 1)),
-                        mult3(dz * obb.half_extents.z, matrix3_column(rot_obb, 2))
-                    )
-                );
-                Vector3 corner = sum3(obb.center, offset);
-
-                // Vector from AABB to OBB corner
-                Vector3 diff = diff3(corner, aabb.center);
-                float depth = -dot3(diff, normal);  // Negative = into AABB
-
-                if (depth > max_penetration) {
-                    max_penetration = depth;
-                    contact_point = corner;
-                }
-            }
-        }
-    }
-
-    // Project deepest point onto AABB face (by removing normal component of penetration)
-    contact_point = sum3(contact_point, mult3(max_penetration, normal));
-
-    // Clamp to AABB bounds along the tangent directions (to get a valid surface point)
-    Vector3 aabb_min = diff3(aabb.center, aabb.half_extents);
-    Vector3 aabb_max = sum3(aabb.center, aabb.half_extents);
-
-    for (int i = 0; i < 3; i++) {
-        // If normal is mostly aligned with this axis, skip clamping that axis
-        if (fabsf(vec3_get(normal, i)) > 0.99f) continue;
-
-        float v = vec3_get(contact_point, i);
-        v = fmaxf(vec3_get(aabb_min, i), fminf(v, vec3_get(aabb_max, i)));
-        vec3_set(&contact_point, i, v);
-    }
-
-    return contact_point;
-}
-
-
-
-Penetration penetration_cuboid_aabb(Cuboid cuboid, AABB aabb) {
+Penetration penetration_cuboid_aabb(Cuboid cuboid, AABB aabb, int* axis) {
     Cuboid cuboid_aabb = {
         .center = aabb.center,
         .half_extents = aabb.half_extents,
         .rotation = quaternion_id(),
     };
 
-    Penetration penetration = penetration_cuboid_cuboid(cuboid, cuboid_aabb);
-    penetration.contact_point = contact_point_obb_aabb(cuboid, aabb, penetration.overlap);
-
-    return penetration;
+    return penetration_cuboid_cuboid(cuboid, cuboid_aabb, axis);
 }
 
 
@@ -550,9 +576,513 @@ Penetration penetration_capsule_aabb(Capsule capsule, AABB aabb) {
 }
 
 
-Penetration get_penetration(Entity i, Entity j) {
-    ColliderComponent* collider = scene->components->collider[i];
-    ColliderComponent* other_collider = scene->components->collider[j];
+// Contacts with several triangles are merged if their normals are within about 18 degrees
+#define MESH_NORMAL_TOLERANCE 0.95f
+#define MAX_MESH_CONTACTS 32
+
+
+typedef struct {
+    ContactPoint contact;
+    Vector3 normal;  // Pushes the shape out of the triangle
+    float depth;  // Penetration of the shape into the whole triangle
+} MeshContact;
+
+
+typedef struct {
+    ColliderType type;
+    Shape shape;
+    BVH* bvh;
+    Heightfield* heightfield;  // Source of the triangles instead of the BVH for heightfields
+    Vector3 center;
+    Vector3 scale;
+    Matrix3 rot;
+    MeshContact contacts[MAX_MESH_CONTACTS];
+    int size;
+} MeshQuery;
+
+
+static void add_mesh_contact(MeshQuery* query, int triangle, Vector3 normal, float depth, ContactPoint contact) {
+    // Points are named after their triangle, the shape tests use the lowest 10 bits
+    contact.feature = (triangle << 10) | contact.feature;
+    MeshContact mesh_contact = {
+        .contact = contact,
+        .normal = normal,
+        .depth = depth
+    };
+
+    if (query->size < MAX_MESH_CONTACTS) {
+        query->contacts[query->size++] = mesh_contact;
+        return;
+    }
+
+    // Replace the contact with the shallowest triangle when the buffer is full
+    int shallowest = 0;
+    for (int i = 1; i < query->size; i++) {
+        if (query->contacts[i].depth < query->contacts[shallowest].depth) {
+            shallowest = i;
+        }
+    }
+    if (depth > query->contacts[shallowest].depth) {
+        query->contacts[shallowest] = mesh_contact;
+    }
+}
+
+
+static Vector3 closest_point_on_triangle(Triangle triangle, Vector3 point) {
+    // Real-Time Collision Detection 5.1.5, checks the Voronoi regions of the corners and edges first
+    Vector3 ab = diff3(triangle.b, triangle.a);
+    Vector3 ac = diff3(triangle.c, triangle.a);
+    Vector3 ap = diff3(point, triangle.a);
+    float d1 = dot3(ab, ap);
+    float d2 = dot3(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return triangle.a;
+
+    Vector3 bp = diff3(point, triangle.b);
+    float d3 = dot3(ab, bp);
+    float d4 = dot3(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return triangle.b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        return sum3(triangle.a, mult3(d1 / (d1 - d3), ab));
+    }
+
+    Vector3 cp = diff3(point, triangle.c);
+    float d5 = dot3(ab, cp);
+    float d6 = dot3(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return triangle.c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        return sum3(triangle.a, mult3(d2 / (d2 - d6), ac));
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        return sum3(triangle.b, mult3(w, diff3(triangle.c, triangle.b)));
+    }
+
+    float denom = 1.0f / (va + vb + vc);
+    return sum3(triangle.a, sum3(mult3(vb * denom, ab), mult3(vc * denom, ac)));
+}
+
+
+static Vector3 closest_point_between_segments(Vector3 p0, Vector3 p1, Vector3 q0, Vector3 q1) {
+    // Point on the first segment, Real-Time Collision Detection 5.1.9
+    const float eps = 1e-8f;
+
+    Vector3 d1 = diff3(p1, p0);
+    Vector3 d2 = diff3(q1, q0);
+    Vector3 r = diff3(p0, q0);
+    float a = dot3(d1, d1);
+    float e = dot3(d2, d2);
+    if (a <= eps) return p0;
+
+    float c = dot3(d1, r);
+    float s;
+    if (e <= eps) {
+        s = clamp(-c / a, 0.0f, 1.0f);
+    } else {
+        float b = dot3(d1, d2);
+        float f = dot3(d2, r);
+        float denom = a * e - b * b;
+        s = denom > eps ? clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+        float t = (b * s + f) / e;
+        if (t < 0.0f) {
+            s = clamp(-c / a, 0.0f, 1.0f);
+        } else if (t > 1.0f) {
+            s = clamp((b - c) / a, 0.0f, 1.0f);
+        }
+    }
+
+    return sum3(p0, mult3(s, d1));
+}
+
+
+static void sphere_triangle(MeshQuery* query, int index, Triangle triangle, Vector3 normal, Sphere sphere, int feature) {
+    Vector3 closest = closest_point_on_triangle(triangle, sphere.center);
+    Vector3 diff = diff3(sphere.center, closest);
+    float dist = norm3(diff);
+    if (dist >= sphere.radius) {
+        return;
+    }
+
+    // A center on the triangle is pushed out along the face normal
+    Vector3 direction = normal;
+    if (dist > 1e-6f) {
+        direction = div3(dist, diff);
+    }
+    float depth = sphere.radius - dist;
+
+    ContactPoint contact = {
+        .point = diff3(closest, mult3(0.5f * depth, direction)),
+        .depth = depth,
+        .feature = feature
+    };
+    add_mesh_contact(query, index, direction, depth, contact);
+}
+
+
+static void capsule_triangle(MeshQuery* query, int index, Triangle triangle, Vector3 normal, Capsule capsule) {
+    Matrix3 rot = quaternion_to_rotation_matrix(capsule.rotation);
+    Vector3 h = matrix3_map(rot, vec3(0.0f, capsule.height / 2.0f, 0.0f));
+    Vector3 p0 = sum3(capsule.center, h);
+    Vector3 p1 = diff3(capsule.center, h);
+
+    // The segment is closest to the triangle at an end, next to an edge or where it crosses the face
+    Vector3 vertices[3] = { triangle.a, triangle.b, triangle.c };
+    Vector3 candidates[6] = { p0, p1 };
+    int size = 2;
+    for (int i = 0; i < 3; i++) {
+        candidates[size++] = closest_point_between_segments(p0, p1, vertices[i], vertices[(i + 1) % 3]);
+    }
+    float d0 = dot3(diff3(p0, triangle.a), normal);
+    float d1 = dot3(diff3(p1, triangle.a), normal);
+    if (d0 * d1 < 0.0f) {
+        candidates[size++] = sum3(p0, mult3(d0 / (d0 - d1), diff3(p1, p0)));
+    }
+
+    for (int i = 0; i < size; i++) {
+        Sphere sphere = {
+            .center = candidates[i],
+            .radius = capsule.radius
+        };
+        sphere_triangle(query, index, triangle, normal, sphere, i);
+    }
+}
+
+
+static void cuboid_triangle(MeshQuery* query, int index, Triangle triangle, Vector3 normal, Cuboid cuboid) {
+    Matrix3 rot = quaternion_to_rotation_matrix(cuboid.rotation);
+    Vector3 axes[3] = { matrix3_column(rot, 0), matrix3_column(rot, 1), matrix3_column(rot, 2) };
+    Vector3 vertices[3] = { triangle.a, triangle.b, triangle.c };
+    Vector3 edges[3] = { diff3(triangle.b, triangle.a), diff3(triangle.c, triangle.b), diff3(triangle.a, triangle.c) };
+
+    // Separating axes are the triangle normal, the box axes and the cross products of their edges
+    float min_overlap = INFINITY;
+    Vector3 push = zeros3();
+    for (int k = 0; k < 13; k++) {
+        Vector3 axis;
+        if (k == 0) {
+            axis = normal;
+        } else if (k < 4) {
+            axis = axes[k - 1];
+        } else {
+            axis = cross(axes[(k - 4) / 3], edges[(k - 4) % 3]);
+            float axis_norm = norm3(axis);
+            if (axis_norm < 1e-4f) continue;
+            axis = div3(axis_norm, axis);
+        }
+
+        float r = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            r += vec3_get(cuboid.half_extents, i) * fabsf(dot3(axes[i], axis));
+        }
+        float c = dot3(cuboid.center, axis);
+        float t_min = INFINITY;
+        float t_max = -INFINITY;
+        for (int i = 0; i < 3; i++) {
+            float t = dot3(vertices[i], axis);
+            t_min = fminf(t_min, t);
+            t_max = fmaxf(t_max, t);
+        }
+
+        float above = t_max - (c - r);
+        float below = (c + r) - t_min;
+        float overlap = fminf(above, below);
+        if (overlap < 0.0f) {
+            return;
+        }
+
+        // Edge axes have to be clearly better, so that boxes sliding over a flat mesh do not catch
+        // on the edges between its triangles
+        bool better = (k < 4) ? overlap < min_overlap : overlap < 0.95f * min_overlap - 0.001f;
+        if (better) {
+            min_overlap = overlap;
+            push = (above < below) ? axis : neg3(axis);
+        }
+    }
+
+    // The face most aligned with the axis is the reference and clips the other shape
+    float dots[3];
+    for (int i = 0; i < 3; i++) {
+        dots[i] = dot3(push, axes[i]);
+    }
+    int box_face = abs_argmax(dots, 3);
+
+    PolygonShape clipped = { .size = 0 };
+    Vector3 ref_normal;  // Points from the reference face into the other shape
+    Vector3 ref_point;
+    int ref_feature;
+
+    if (fabsf(dot3(push, normal)) >= fabsf(dots[box_face])) {
+        ref_normal = dot3(normal, push) > 0.0f ? normal : neg3(normal);
+        ref_point = triangle.a;
+        ref_feature = 6;
+
+        float inc_dots[3];
+        for (int i = 0; i < 3; i++) {
+            inc_dots[i] = dot3(ref_normal, axes[i]);
+        }
+        int inc_axis = abs_argmax(inc_dots, 3);
+        float inc_sign = sign(inc_dots[inc_axis]);
+        Vector3 inc_face_center = sum3(cuboid.center, mult3(-inc_sign * vec3_get(cuboid.half_extents, inc_axis), axes[inc_axis]));
+        int u = (inc_axis + 1) % 3;
+        int v = (inc_axis + 2) % 3;
+
+        const float corners[4][2] = { { -1, -1 }, { -1, 1 }, { 1, 1 }, { 1, -1 } };
+        clipped.size = 4;
+        for (int i = 0; i < 4; i++) {
+            Vector3 offset = sum3(
+                mult3(corners[i][0] * vec3_get(cuboid.half_extents, u), axes[u]),
+                mult3(corners[i][1] * vec3_get(cuboid.half_extents, v), axes[v])
+            );
+            clipped.points[i] = sum3(inc_face_center, offset);
+            clipped.features[i] = i;
+        }
+
+        for (int i = 0; i < 3 && clipped.size > 0; i++) {
+            Vector3 a = vertices[i];
+            Vector3 side = normalized3(cross(edges[i], ref_normal));
+            if (dot3(side, diff3(vertices[(i + 2) % 3], a)) > 0.0f) {
+                side = neg3(side);
+            }
+            clip_polygon(&clipped, (Plane) { side, dot3(side, a) }, i);
+        }
+    } else {
+        float face_sign = sign(dots[box_face]);
+        ref_normal = mult3(-face_sign, axes[box_face]);
+        ref_point = sum3(cuboid.center, mult3(vec3_get(cuboid.half_extents, box_face), ref_normal));
+        ref_feature = 2 * box_face + (face_sign > 0.0f);
+
+        clipped.size = 3;
+        for (int i = 0; i < 3; i++) {
+            clipped.points[i] = vertices[i];
+            clipped.features[i] = i;
+        }
+
+        Vector3 ref_u = axes[(box_face + 1) % 3];
+        Vector3 ref_v = axes[(box_face + 2) % 3];
+        float hu = vec3_get(cuboid.half_extents, (box_face + 1) % 3);
+        float hv = vec3_get(cuboid.half_extents, (box_face + 2) % 3);
+        Plane planes[4] = {
+            { ref_u, dot3(ref_u, sum3(ref_point, mult3(hu, ref_u))) },
+            { neg3(ref_u), dot3(neg3(ref_u), diff3(ref_point, mult3(hu, ref_u))) },
+            { ref_v, dot3(ref_v, sum3(ref_point, mult3(hv, ref_v))) },
+            { neg3(ref_v), dot3(neg3(ref_v), diff3(ref_point, mult3(hv, ref_v))) }
+        };
+        for (int i = 0; i < 4 && clipped.size > 0; i++) {
+            clip_polygon(&clipped, planes[i], i);
+        }
+    }
+
+    // Keep the points behind the reference face, halfway between the two surfaces
+    int added = 0;
+    for (int i = 0; i < clipped.size; i++) {
+        Vector3 p = clipped.points[i];
+        float depth = dot3(diff3(p, ref_point), ref_normal);
+        if (depth > CONTACT_THRESHOLD) {
+            continue;
+        }
+
+        ContactPoint contact = {
+            .point = diff3(p, mult3(0.5f * depth, ref_normal)),
+            .depth = fmaxf(-depth, 0.0f),
+            .feature = (ref_feature << 7) | clipped.features[i]
+        };
+        add_mesh_contact(query, index, push, min_overlap, contact);
+        added++;
+    }
+
+    // Edges crossing each other leave nothing after clipping
+    if (added == 0) {
+        ContactPoint contact = {
+            .point = closest_point_on_triangle(triangle, cuboid.center),
+            .depth = min_overlap,
+            .feature = 7 << 7
+        };
+        add_mesh_contact(query, index, push, min_overlap, contact);
+    }
+}
+
+
+static bool mesh_triangle(void* data, int index) {
+    MeshQuery* query = data;
+
+    Triangle local = query->heightfield ? Heightfield_triangle(query->heightfield, index) : BVH_triangle(query->bvh, index);
+    Triangle triangle = {
+        .a = sum3(query->center, matrix3_map(query->rot, prod3(query->scale, local.a))),
+        .b = sum3(query->center, matrix3_map(query->rot, prod3(query->scale, local.b))),
+        .c = sum3(query->center, matrix3_map(query->rot, prod3(query->scale, local.c)))
+    };
+
+    Vector3 normal = cross(diff3(triangle.b, triangle.a), diff3(triangle.c, triangle.a));
+    float area = norm3(normal);
+    if (area < 1e-8f) {
+        return true;
+    }
+    normal = div3(area, normal);
+
+    switch (query->type) {
+        case COLLIDER_SPHERE:
+            sphere_triangle(query, index, triangle, normal, query->shape.sphere, 0);
+            break;
+        case COLLIDER_CAPSULE:
+            capsule_triangle(query, index, triangle, normal, query->shape.capsule);
+            break;
+        case COLLIDER_CUBOID:
+            cuboid_triangle(query, index, triangle, normal, query->shape.cuboid);
+            break;
+        case COLLIDER_AABB: {
+            Cuboid cuboid = {
+                .center = query->shape.aabb.center,
+                .half_extents = query->shape.aabb.half_extents,
+                .rotation = quaternion_id()
+            };
+            cuboid_triangle(query, index, triangle, normal, cuboid);
+            break;
+        }
+        default:
+            break;
+    }
+
+    return true;
+}
+
+
+static void local_bounds(MeshQuery* query, AABB bounds, Vector3* min, Vector3* max) {
+    // The bounds of the shape in the frame of the mesh select the triangles to test
+    Matrix3 inv_rot = transpose3(query->rot);
+    Vector3 inv_scale = vec3(1.0f / query->scale.x, 1.0f / query->scale.y, 1.0f / query->scale.z);
+    Vector3 center = prod3(inv_scale, matrix3_map(inv_rot, diff3(bounds.center, query->center)));
+    Vector3 half_extents = prod3(
+        vec3(fabsf(inv_scale.x), fabsf(inv_scale.y), fabsf(inv_scale.z)),
+        matrix3_map(matrix3_abs(inv_rot), bounds.half_extents)
+    );
+    *min = diff3(center, half_extents);
+    *max = sum3(center, half_extents);
+}
+
+
+static bool mesh_tests_type(ColliderType type) {
+    return type == COLLIDER_SPHERE || type == COLLIDER_CAPSULE || type == COLLIDER_CUBOID || type == COLLIDER_AABB;
+}
+
+
+static Penetration merge_mesh_contacts(MeshQuery query) {
+    Penetration penetration = {
+        .valid = false
+    };
+
+    if (query.size == 0) {
+        return penetration;
+    }
+
+    // The deepest triangle decides the normal, the points of triangles facing the same way are kept
+    int deepest = 0;
+    for (int i = 1; i < query.size; i++) {
+        if (query.contacts[i].depth > query.contacts[deepest].depth) {
+            deepest = i;
+        }
+    }
+    Vector3 normal = query.contacts[deepest].normal;
+
+    ContactPoint contacts[MAX_MESH_CONTACTS];
+    int size = 0;
+    for (int i = 0; i < query.size; i++) {
+        if (dot3(query.contacts[i].normal, normal) < MESH_NORMAL_TOLERANCE) {
+            continue;
+        }
+
+        // Triangles sharing an edge or a corner find the same point
+        ContactPoint contact = query.contacts[i].contact;
+        bool duplicate = false;
+        for (int j = 0; j < size; j++) {
+            if (norm3(diff3(contacts[j].point, contact.point)) < CONTACT_THRESHOLD) {
+                if (contact.depth > contacts[j].depth) {
+                    contacts[j] = contact;
+                }
+                duplicate = true;
+                break;
+            }
+        }
+        if (!duplicate) {
+            contacts[size++] = contact;
+        }
+    }
+
+    size = reduce_contacts(contacts, size);
+
+    penetration.valid = true;
+    penetration.overlap = mult3(query.contacts[deepest].depth, normal);
+    penetration.feature = query.contacts[deepest].contact.feature >> 10;
+    penetration.contacts_size = size;
+    memcpy(penetration.contacts, contacts, sizeof(ContactPoint) * size);
+    penetration.contact_point = zeros3();
+    for (int i = 0; i < size; i++) {
+        penetration.contact_point = sum3(penetration.contact_point, contacts[i].point);
+    }
+    penetration.contact_point = div3((float) size, penetration.contact_point);
+
+    return penetration;
+}
+
+
+Penetration penetration_mesh(ColliderType type, Shape shape, AABB bounds, MeshShape mesh) {
+    if (!mesh_tests_type(type)) {
+        return (Penetration) { .valid = false };
+    }
+
+    MeshQuery query = {
+        .type = type,
+        .shape = shape,
+        .bvh = resources.meshes[mesh.mesh_index].bvh,
+        .heightfield = NULL,
+        .center = mesh.center,
+        .scale = mesh.scale,
+        .rot = quaternion_to_rotation_matrix(mesh.rotation),
+        .size = 0
+    };
+
+    Vector3 min;
+    Vector3 max;
+    local_bounds(&query, bounds, &min, &max);
+    BVH_query(query.bvh, min, max, mesh_triangle, &query);
+
+    return merge_mesh_contacts(query);
+}
+
+
+Penetration penetration_heightfield(ColliderType type, Shape shape, AABB bounds, HeightfieldShape heightfield) {
+    if (!mesh_tests_type(type)) {
+        return (Penetration) { .valid = false };
+    }
+
+    MeshQuery query = {
+        .type = type,
+        .shape = shape,
+        .bvh = NULL,
+        .heightfield = heightfield.heightfield,
+        .center = heightfield.center,
+        .scale = heightfield.scale,
+        .rot = quaternion_to_rotation_matrix(heightfield.rotation),
+        .size = 0
+    };
+
+    // Only the cells under the shape are visited, however large the terrain is
+    Vector3 min;
+    Vector3 max;
+    local_bounds(&query, bounds, &min, &max);
+    Heightfield_query(query.heightfield, min, max, mesh_triangle, &query);
+
+    return merge_mesh_contacts(query);
+}
+
+
+Penetration get_penetration_cached(Entity i, Entity j, int* axis) {
+    ColliderComponent* collider = get_component(i, COMPONENT_COLLIDER);
+    ColliderComponent* other_collider = get_component(j, COMPONENT_COLLIDER);
 
     if (!collider || !other_collider) {
         return (Penetration) {
@@ -560,11 +1090,26 @@ Penetration get_penetration(Entity i, Entity j) {
         };
     }
 
-    Shape shape = get_shape(i);
-    Shape shape_other = get_shape(j);
+    Shape shape = collider->shape;
+    Shape shape_other = other_collider->shape;
+
+    // Triangle shapes come before the plane swap, which would otherwise undo theirs
+    if (other_collider->type == COLLIDER_MESH) {
+        return penetration_mesh(collider->type, shape, collider->bounds, shape_other.mesh);
+    }
+
+    if (other_collider->type == COLLIDER_HEIGHTFIELD) {
+        return penetration_heightfield(collider->type, shape, collider->bounds, shape_other.heightfield);
+    }
+
+    if (collider->type == COLLIDER_MESH || collider->type == COLLIDER_HEIGHTFIELD) {
+        Penetration penetration = get_penetration_cached(j, i, axis);
+        penetration.overlap = neg3(penetration.overlap);
+        return penetration;
+    }
 
     if (collider->type == COLLIDER_PLANE && other_collider->type != COLLIDER_PLANE) {
-        Penetration penetration = get_penetration(j, i);
+        Penetration penetration = get_penetration_cached(j, i, axis);
         penetration.overlap = neg3(penetration.overlap);
         return penetration;
     }
@@ -593,7 +1138,7 @@ Penetration get_penetration(Entity i, Entity j) {
     }
 
     if (collider->type == COLLIDER_CUBOID && other_collider->type == COLLIDER_CUBOID) {
-        return penetration_cuboid_cuboid(shape.cuboid, shape_other.cuboid);
+        return penetration_cuboid_cuboid(shape.cuboid, shape_other.cuboid, axis);
     }
 
     if (collider->type == COLLIDER_CAPSULE && other_collider->type == COLLIDER_PLANE) {
@@ -611,11 +1156,11 @@ Penetration get_penetration(Entity i, Entity j) {
     }
 
     if (collider->type == COLLIDER_CUBOID && other_collider->type == COLLIDER_AABB) {
-        return penetration_cuboid_aabb(shape.cuboid, shape_other.aabb);
+        return penetration_cuboid_aabb(shape.cuboid, shape_other.aabb, axis);
     }
 
     if (collider->type == COLLIDER_AABB && other_collider->type == COLLIDER_CUBOID) {
-        Penetration penetration = penetration_cuboid_aabb(shape_other.cuboid, shape.aabb);
+        Penetration penetration = penetration_cuboid_aabb(shape_other.cuboid, shape.aabb, axis);
         penetration.overlap = neg3(penetration.overlap);
         return penetration;
     }
@@ -638,47 +1183,391 @@ Penetration get_penetration(Entity i, Entity j) {
 }
 
 
-void update_collisions() {
-    for (Entity i = 0; i < scene->components->entities; i++) {
-        ColliderComponent* collider = get_component(i, COMPONENT_COLLIDER);
-        if (!collider) continue;
+Penetration get_penetration(Entity i, Entity j) {
+    return get_penetration_cached(i, j, NULL);
+}
+
 
-        ArrayList_clear(collider->collisions);
+static void capsule_segment(Capsule capsule, Vector3* p0, Vector3* p1) {
+    Matrix3 rot = quaternion_to_rotation_matrix(capsule.rotation);
+    Vector3 h = matrix3_map(rot, vec3(0.0f, capsule.height / 2.0f, 0.0f));
+    *p0 = sum3(capsule.center, h);
+    *p1 = diff3(capsule.center, h);
+}
+
+
+bool test_overlap(Entity i, Entity j, int* axis) {
+    // Boolean tests for the shapes sensors usually have, the rest go through the full test
+    ColliderComponent* collider = get_component(i, COMPONENT_COLLIDER);
+    ColliderComponent* other_collider = get_component(j, COMPONENT_COLLIDER);
+    if (!collider || !other_collider) {
+        return false;
     }
 
-    for (Entity i = 0; i < scene->components->entities; i++) {
-        ColliderComponent* collider = get_component(i, COMPONENT_COLLIDER);
-        if (!collider) continue;
+    // Order the pair by type to halve the cases
+    if (collider->type > other_collider->type) {
+        ColliderComponent* swap = collider;
+        collider = other_collider;
+        other_collider = swap;
+    }
+    Shape shape = collider->shape;
+    Shape shape_other = other_collider->shape;
 
-        for (Entity j = 0; j < i; j++) {
-            ColliderComponent* other_collider = get_component(j, COMPONENT_COLLIDER);
-            if (!other_collider) continue;
+    if (collider->type == COLLIDER_SPHERE && other_collider->type == COLLIDER_SPHERE) {
+        Vector3 diff = diff3(shape.sphere.center, shape_other.sphere.center);
+        float radius = shape.sphere.radius + shape_other.sphere.radius;
+        return dot3(diff, diff) < radius * radius;
+    }
 
-            // TODO: Handle unsymmetric collisions
-            bool collides = (COLLISION_MASKS[collider->group] & other_collider->group);
-            bool other_collides = (COLLISION_MASKS[other_collider->group] & collider->group);
+    if (collider->type == COLLIDER_SPHERE && other_collider->type == COLLIDER_CUBOID) {
+        Cuboid cuboid = shape_other.cuboid;
+        Matrix3 inv_rot = transpose3(quaternion_to_rotation_matrix(cuboid.rotation));
+        Vector3 local = matrix3_map(inv_rot, diff3(shape.sphere.center, cuboid.center));
+        Vector3 diff = diff3(local, clamp3(local, neg3(cuboid.half_extents), cuboid.half_extents));
+        return dot3(diff, diff) < shape.sphere.radius * shape.sphere.radius;
+    }
 
-            if (!collides && !other_collides) {
-                continue;
+    if (collider->type == COLLIDER_SPHERE && other_collider->type == COLLIDER_CAPSULE) {
+        Vector3 p0;
+        Vector3 p1;
+        capsule_segment(shape_other.capsule, &p0, &p1);
+        Vector3 diff = diff3(shape.sphere.center, closest_point_on_segment(p0, p1, shape.sphere.center));
+        float radius = shape.sphere.radius + shape_other.capsule.radius;
+        return dot3(diff, diff) < radius * radius;
+    }
+
+    if (collider->type == COLLIDER_SPHERE && other_collider->type == COLLIDER_AABB) {
+        Vector3 diff = diff3(shape.sphere.center, closest_point_on_aabb(shape_other.aabb, shape.sphere.center));
+        return dot3(diff, diff) < shape.sphere.radius * shape.sphere.radius;
+    }
+
+    if (collider->type == COLLIDER_CAPSULE && other_collider->type == COLLIDER_AABB) {
+        return penetration_capsule_aabb(shape.capsule, shape_other.aabb).valid;
+    }
+
+    if (collider->type == COLLIDER_AABB && other_collider->type == COLLIDER_AABB) {
+        Vector3 diff = diff3(shape.aabb.center, shape_other.aabb.center);
+        Vector3 extents = sum3(shape.aabb.half_extents, shape_other.aabb.half_extents);
+        return fabsf(diff.x) < extents.x && fabsf(diff.y) < extents.y && fabsf(diff.z) < extents.z;
+    }
+
+    return get_penetration_cached(i, j, axis).valid;
+}
+
+
+static int replaced_contact(Manifold* manifold, Contact contact) {
+    // Keep the deepest point and replace the one that leaves the largest area without it
+    int deepest = -1;
+    float max_depth = contact.depth;
+    for (int i = 0; i < MAX_MANIFOLD_POINTS; i++) {
+        if (manifold->contacts[i].depth > max_depth) {
+            max_depth = manifold->contacts[i].depth;
+            deepest = i;
+        }
+    }
+
+    int replaced = 0;
+    float max_area = -1.0f;
+    for (int i = 0; i < MAX_MANIFOLD_POINTS; i++) {
+        if (i == deepest) continue;
+
+        Vector3 points[MAX_MANIFOLD_POINTS];
+        for (int j = 0; j < MAX_MANIFOLD_POINTS; j++) {
+            points[j] = (i == j) ? contact.local_point : manifold->contacts[j].local_point;
+        }
+        float area = manifold_area(points[0], points[1], points[2], points[3]);
+        if (area > max_area) {
+            max_area = area;
+            replaced = i;
+        }
+    }
+
+    return replaced;
+}
+
+
+static int matched_contact(Manifold* manifold, Contact contact, bool* used) {
+    // A nearby point from the same feature wins over the nearest one
+    int match = -1;
+    float min_distance = CONTACT_THRESHOLD;
+    for (int i = 0; i < manifold->size; i++) {
+        if (used[i]) continue;
+
+        float distance = norm3(diff3(manifold->contacts[i].local_point, contact.local_point));
+        if (distance > CONTACT_THRESHOLD) continue;
+
+        if (manifold->contacts[i].feature == contact.feature) {
+            return i;
+        }
+        if (distance < min_distance) {
+            match = i;
+            min_distance = distance;
+        }
+    }
+    return match;
+}
+
+
+static void update_manifold(Manifold* manifold, Entity entity, Entity other, Penetration penetration) {
+    // Shapes that report a full set of points replace the manifold, the points only inherit
+    // impulses from their matches. Otherwise points from earlier ticks are kept while they still
+    // touch, so a single new point per tick builds up a manifold that can hold a body steady.
+    // Everything is stored relative to the lower entity of the pair.
+    if (entity > other) {
+        Entity swap = entity;
+        entity = other;
+        other = swap;
+        penetration.overlap = neg3(penetration.overlap);
+    }
+
+    Vector3 normal = normalized3(penetration.overlap);
+
+    Vector3 position = get_position(entity);
+    Matrix3 rot = quaternion_to_rotation_matrix(get_rotation(entity));
+    Vector3 position_other = get_position(other);
+    Matrix3 rot_other = quaternion_to_rotation_matrix(get_rotation(other));
+
+    // Drop points that have separated or slid along the contact plane
+    int size = 0;
+    for (int i = 0; i < manifold->size; i++) {
+        Contact contact = manifold->contacts[i];
+        Vector3 point = sum3(position, matrix3_map(rot, contact.local_point));
+        Vector3 point_other = sum3(position_other, matrix3_map(rot_other, contact.local_point_other));
+        Vector3 diff = diff3(point, point_other);
+        float separation = dot3(diff, normal);
+        Vector3 drift = diff3(diff, mult3(separation, normal));
+        if (separation > CONTACT_THRESHOLD || norm3(drift) > CONTACT_THRESHOLD) {
+            continue;
+        }
+        contact.depth = fmaxf(-separation, 0.0f);
+        contact.point = mult3(0.5f, sum3(point, point_other));
+        manifold->contacts[size] = contact;
+        size++;
+    }
+    manifold->size = size;
+    manifold->normal = normal;
+
+    ContactPoint points[MAX_CONTACT_POINTS] = {
+        {
+            .point = penetration.contact_point,
+            .depth = norm3(penetration.overlap),
+            .feature = penetration.feature
+        }
+    };
+    int points_size = 1;
+    if (penetration.contacts_size > 0) {
+        memcpy(points, penetration.contacts, sizeof(ContactPoint) * penetration.contacts_size);
+        points_size = penetration.contacts_size;
+    }
+
+    bool used[MAX_MANIFOLD_POINTS] = { false };
+    Contact contacts[MAX_MANIFOLD_POINTS];
+    int match = -1;
+    for (int i = 0; i < points_size; i++) {
+        // The reported point lies between the surfaces, split it into a point on each body
+        float depth = points[i].depth;
+        Vector3 point = diff3(points[i].point, mult3(0.5f * depth, normal));
+        Vector3 point_other = sum3(points[i].point, mult3(0.5f * depth, normal));
+        Contact contact = {
+            .feature = points[i].feature,
+            .local_point = matrix3_map(transpose3(rot), diff3(point, position)),
+            .local_point_other = matrix3_map(transpose3(rot_other), diff3(point_other, position_other)),
+            .point = points[i].point,
+            .depth = depth,
+            .normal_impulse = 0.0f,
+            .friction_impulse = zeros3(),
+            .target_velocity = 0.0f
+        };
+
+        match = matched_contact(manifold, contact, used);
+        if (match != -1) {
+            contact.normal_impulse = manifold->contacts[match].normal_impulse;
+            contact.friction_impulse = manifold->contacts[match].friction_impulse;
+            used[match] = true;
+        }
+        contacts[i] = contact;
+    }
+
+    if (penetration.contacts_size > 0) {
+        memcpy(manifold->contacts, contacts, sizeof(Contact) * points_size);
+        manifold->size = points_size;
+        return;
+    }
+
+    if (match == -1) {
+        if (manifold->size < MAX_MANIFOLD_POINTS) {
+            match = manifold->size;
+            manifold->size++;
+        } else {
+            match = replaced_contact(manifold, contacts[0]);
+        }
+    }
+    manifold->contacts[match] = contacts[0];
+}
+
+
+// Pairs of boxes where at least one is rotated go through the separating axis test
+static bool tests_axes(Entity i, Entity j) {
+    ColliderType type = ((ColliderComponent*) get_component(i, COMPONENT_COLLIDER))->type;
+    ColliderType type_other = ((ColliderComponent*) get_component(j, COMPONENT_COLLIDER))->type;
+    if (type == COLLIDER_CUBOID) {
+        return type_other == COLLIDER_CUBOID || type_other == COLLIDER_AABB;
+    }
+    return type == COLLIDER_AABB && type_other == COLLIDER_CUBOID;
+}
+
+
+static void index_events(ComponentArray* colliders) {
+    // Counting sort of the events by collider, which keeps the pair order for each collider
+    ContactCache* cache = scene->contacts;
+    for (int e = 0; e < cache->events_size; e++) {
+        Entity entities[2] = { cache->events[e].entity, cache->events[e].other };
+        for (int k = 0; k < 2; k++) {
+            // Entities destroyed since the pair stopped touching have no events
+            int index = ComponentArray_index(colliders, entities[k]);
+            if (index != -1) {
+                ColliderComponent* collider = get_component(entities[k], COMPONENT_COLLIDER);
+                collider->events_size++;
             }
+        }
+    }
 
-            Penetration penetration = get_penetration(i, j);
-            if (penetration.valid) {
-                Collision collision = {
-                    .entity = j,
-                    .overlap = penetration.overlap,
-                    .offset = diff3(penetration.contact_point, get_position(i)),
-                    .offset_other = diff3(penetration.contact_point, get_position(j))
-                };
-                ArrayList_add(collider->collisions, &collision);
-                Collision other_collision = {
-                    .entity = i,
-                    .overlap = mult3(-1.0f, penetration.overlap),
-                    .offset = diff3(penetration.contact_point, get_position(j)),
-                    .offset_other = diff3(penetration.contact_point, get_position(i))
-                };
-                ArrayList_add(other_collider->collisions, &other_collision);
+    int start = 0;
+    for (int k = 0; k < colliders->size; k++) {
+        ColliderComponent* collider = get_component(colliders->entities[k], COMPONENT_COLLIDER);
+        collider->events_start = start;
+        start += collider->events_size;
+        collider->events_size = 0;
+    }
+
+    for (int e = 0; e < cache->events_size; e++) {
+        Entity entities[2] = { cache->events[e].entity, cache->events[e].other };
+        for (int k = 0; k < 2; k++) {
+            int index = ComponentArray_index(colliders, entities[k]);
+            if (index != -1) {
+                ColliderComponent* collider = get_component(entities[k], COMPONENT_COLLIDER);
+                cache->entity_events[collider->events_start + collider->events_size++] = e;
             }
         }
     }
 }
+
+
+ContactEvent* get_contact_event(ColliderComponent* collider, int index) {
+    ContactCache* cache = scene->contacts;
+    return &cache->events[cache->entity_events[collider->events_start + index]];
+}
+
+
+Collision get_collision(ContactEvent* event, Entity entity, int point) {
+    Manifold* manifold = ContactCache_get(scene->contacts, event->manifold);
+    Contact* contact = &manifold->contacts[point];
+
+    // The manifold is stored for the lower entity of the pair
+    bool lower = (entity == event->entity);
+    Vector3 normal = lower ? manifold->normal : neg3(manifold->normal);
+
+    return (Collision) {
+        .entity = lower ? event->other : event->entity,
+        .overlap = mult3(contact->depth / manifold->size, normal),
+        .offset = lower ? contact->offset : contact->offset_other,
+        .offset_other = lower ? contact->offset_other : contact->offset,
+        .contact = event->manifold * MAX_MANIFOLD_POINTS + point
+    };
+}
+
+
+static int compare_keys(const void* a, const void* b) {
+    unsigned long long key_a = *(unsigned long long*)a;
+    unsigned long long key_b = *(unsigned long long*)b;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+
+void update_collisions() {
+    ComponentArray* colliders = query_entities(COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_COLLIDER));
+
+    for (int k = 0; k < colliders->size; k++) {
+        ColliderComponent* collider = get_component(colliders->entities[k], COMPONENT_COLLIDER);
+        collider->events_size = 0;
+    }
+    update_collider_shapes(colliders);
+
+    Broadphase* broadphase = scene->broadphase;
+    Broadphase_update(broadphase, colliders);
+
+    // Contacts not found again last tick are dropped, the rest keep their impulses
+    ContactCache_prune(scene->contacts);
+    ContactCache_reserve(scene->contacts, broadphase->pairs_size);
+    ContactCache_clear_events(scene->contacts);
+
+    // Visit the candidate pairs in collider order so that the results do not depend on the sweep
+    Narrowphase* narrowphase = scene->narrowphase;
+    Narrowphase_reset(narrowphase, broadphase->pairs_size);
+    unsigned long long* keys = narrowphase->keys;
+    for (int p = 0; p < broadphase->pairs_size; p++) {
+        unsigned long long k = ComponentArray_index(colliders, broadphase->pairs[p].entity);
+        unsigned long long l = ComponentArray_index(colliders, broadphase->pairs[p].other);
+        keys[p] = k > l ? (k << 32) | l : (l << 32) | k;
+    }
+    qsort(keys, broadphase->pairs_size, sizeof(unsigned long long), compare_keys);
+
+    // Test the pairs in parallel, then update the manifolds and events in pair order
+    for (int p = 0; p < broadphase->pairs_size; p++) {
+        Entity i = colliders->entities[keys[p] >> 32];
+        Entity j = colliders->entities[keys[p] & 0xffffffff];
+
+        // Box pairs keep their manifold while the broadphase reports them, so that the separating
+        // axis is remembered. The table was reserved above, so the axes do not move until the merge.
+        int* axis = NULL;
+        if (tests_axes(i, j)) {
+            axis = &ContactCache_get(scene->contacts, ContactCache_find(scene->contacts, i, j))->axis;
+        }
+        Narrowphase_add(narrowphase, p, i, j, axis);
+    }
+    Narrowphase_run(narrowphase);
+
+    for (int p = 0; p < broadphase->pairs_size; p++) {
+        Entity i = colliders->entities[keys[p] >> 32];
+        Entity j = colliders->entities[keys[p] & 0xffffffff];
+
+        Penetration penetration = narrowphase->penetrations[p];
+        if (!penetration.valid && narrowphase->axes[p]) {
+            ContactCache_get(scene->contacts, ContactCache_find(scene->contacts, i, j))->size = 0;
+        }
+        if (!penetration.valid) {
+            continue;
+        }
+
+        int index = ContactCache_find(scene->contacts, i, j);
+        Manifold* manifold = ContactCache_get(scene->contacts, index);
+
+        // Sensors only report that the shapes overlap
+        ColliderComponent* collider = get_component(i, COMPONENT_COLLIDER);
+        ColliderComponent* other_collider = get_component(j, COMPONENT_COLLIDER);
+        manifold->sensor = collider->sensor || other_collider->sensor;
+        if (manifold->sensor) {
+            manifold->size = 0;
+            ContactCache_add_event(scene->contacts, index);
+            continue;
+        }
+
+        update_manifold(manifold, i, j, penetration);
+        if (manifold->size == 0) {
+            continue;
+        }
+
+        // Offsets are taken before the solver moves the bodies
+        Vector3 position = get_position(i < j ? i : j);
+        Vector3 position_other = get_position(i < j ? j : i);
+        for (int c = 0; c < manifold->size; c++) {
+            Contact* contact = &manifold->contacts[c];
+            contact->offset = diff3(contact->point, position);
+            contact->offset_other = diff3(contact->point, position_other);
+        }
+        ContactCache_add_event(scene->contacts, index);
+    }
+    ContactCache_end_events(scene->contacts);
+
+    index_events(colliders);
+}
@@ -314,9 +314,13 @@ void update_controller(Entity entity) {
 
 
 void input_players() {
-    for (int i = 0; i < scene->components->entities; i++) {
+    ComponentArray* players = query_entities(
+        COMPONENT_MASK(COMPONENT_PLAYER) | COMPONENT_MASK(COMPONENT_CONTROLLER) |
+        COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_RIGIDBODY)
+    );
+    for (int k = 0; k < players->size; k++) {
+        Entity i = players->entities[k];
         PlayerComponent* player = get_component(i, COMPONENT_PLAYER);
-        if (!player) continue;
 
         ControllerComponent* controller = get_component(i, COMPONENT_CONTROLLER);
 
@@ -342,12 +346,11 @@ void input_players() {
         Quaternion q_yaw = axis_angle_to_quaternion(vec3(0.0f, 1.0f, 0.0f), to_radians(player->yaw));
         Quaternion q_pitch = axis_angle_to_quaternion(vec3(1.0f, 0.0f, 0.0f), to_radians(player->pitch));
 
-        trans->rotation = q_yaw;
+        set_rotation(i, q_yaw);
 
         // Camera only moves in pitch direction
-        Entity camera = trans->children->head->value;
-        TransformComponent* camera_trans = get_component(camera, COMPONENT_TRANSFORM);
-        camera_trans->rotation = q_pitch;
+        Entity camera = trans->first_child;
+        set_rotation(camera, q_pitch);
 
         if (controller->controller.buttons_pressed[BUTTON_A]) {
             if (rb->on_ground) {
@@ -366,6 +369,7 @@ void input_players() {
                 RigidBodyComponent* grabbed_rb = get_component(player->grabbed_entity, COMPONENT_RIGIDBODY);
                 if (grabbed_rb) {
                     grabbed_rb->gravity_scale = 1.0f;
+                    grabbed_rb->fast = true;
                 }
                 player->grabbed_entity = NULL_ENTITY;
             } else {
@@ -412,6 +416,9 @@ void input_game(SDL_Event sdl_event) {
         if (sdl_event.key.key == SDLK_F1) {
             if (game_settings.debug) {
                 app.debug_level = (app.debug_level + 1) % 4;
+                if (app.debug_level == 1) {
+                    print_component_stats();
+                }
             }
         }
     }
@@ -8,9 +8,14 @@
 #include <render.h>
 
 #include "components/rigidbody.h"
+#include "raycast.h"
 
 
-static int ITERATIONS = 10;
+static int ITERATIONS = 4;
+// Contacts approaching slower than this do not bounce
+static float BOUNCE_THRESHOLD = 0.5f;
+// Overlaps smaller than this are left alone
+static float POSITION_TOLERANCE = 1.0e-4f;
 static Vector3 gravity = { 0.0f, -9.81f, 0.0f };
 
 
@@ -87,132 +92,200 @@ void apply_impulse(Entity entity, Vector3 point, Vector3 impulse) {
 }
 
 
-bool resolve_collisions(Entity entity, float bias) {
-    // Collisions are solved sequentially, updating positions and velocities of both bodies before moving
-    // to the next collision.
+static void combine_materials(RigidBodyComponent* rb, RigidBodyComponent* rb_other, float* bounce, float* friction) {
+    // Take the minimum bounce factor, and maximum friction factor.
+    // Static objects have bounce 1 and friction 0.
+    *bounce = 1.0f;
+    *friction = 0.0f;
+    if (rb) {
+        *bounce = rb->bounce;
+        *friction = rb->friction;
+    }
+    if (rb_other) {
+        *bounce = fminf(*bounce, rb_other->bounce);
+        *friction = fmaxf(*friction, rb_other->friction);
+    }
+}
+
+
+static Vector3 relative_velocity(RigidBodyComponent* rb, Vector3 r, RigidBodyComponent* rb_other, Vector3 r_other) {
+    Vector3 v_rel = zeros3();
+    if (rb) {
+        v_rel = sum3(rb->velocity, cross(rb->angular_velocity, r));
+    }
+    if (rb_other) {
+        Vector3 v_other = sum3(rb_other->velocity, cross(rb_other->angular_velocity, r_other));
+        v_rel = diff3(v_rel, v_other);
+    }
+    return v_rel;
+}
+
 
+static float effective_mass(RigidBodyComponent* rb, Vector3 r, RigidBodyComponent* rb_other, Vector3 r_other, Vector3 axis) {
+    float denom = 0.0f;
+    if (rb) {
+        denom = rb->inv_mass + dot3(axis, cross(matrix3_map(rb->inv_inertia, cross(r, axis)), r));
+    }
+    if (rb_other) {
+        denom += rb_other->inv_mass + dot3(axis, cross(matrix3_map(rb_other->inv_inertia, cross(r_other, axis)), r_other));
+    }
+    return denom;
+}
+
+
+static void warm_start(Entity entity) {
+    // Apply the impulses accumulated for each contact last tick, so that the iterations only have to
+    // correct the difference. Also fixes the bounce velocity of each contact for this tick.
     TransformComponent* trans = get_component(entity, COMPONENT_TRANSFORM);
     RigidBodyComponent* rb = get_component(entity, COMPONENT_RIGIDBODY);
     ColliderComponent* collider = get_component(entity, COMPONENT_COLLIDER);
 
-    bool has_moved = false;
-    if (collider) {
-        for (int i = 0; i < collider->collisions->size; i++) {
-            Collision collision = *(Collision*)ArrayList_get(collider->collisions, i);
-
-            // Only resolve each collision once
-            if (collision.entity > entity) continue;
+    for (int e = 0; e < collider->events_size; e++) {
+        ContactEvent* event = get_contact_event(collider, e);
+        if (event->type == CONTACT_END) continue;
 
+        int points = ContactCache_get(scene->contacts, event->manifold)->size;
+        for (int i = 0; i < points; i++) {
+            Collision collision = get_collision(event, entity, i);
             RigidBodyComponent* rb_other = get_component(collision.entity, COMPONENT_RIGIDBODY);
+            if (rb_other && collision.entity > entity) continue;
 
-            Vector3 delta_position = mult3(bias, collision.overlap);
-            if (rb) {
-                if (rb->axis_lock.x) {
-                    delta_position.x = 0.0f;
-                } else if (rb->axis_lock.y) {
-                    delta_position.y = 0.0f;
-                } else if (rb->axis_lock.z) {
-                    delta_position.z = 0.0f;
-                }
-            }
-
+            Contact* contact = ContactCache_contact(scene->contacts, collision.contact);
             Vector3 n = normalized3(collision.overlap);
             Vector3 r = collision.offset;
-            Vector3 v_rel = zeros3();
-            if (rb) {
-                v_rel = sum3(rb->velocity, cross(rb->angular_velocity, r));
-            }
+            Vector3 r_other = rb_other ? collision.offset_other : zeros3();
 
-            Vector3 r_other = zeros3();
-            if (rb_other) {
-                r_other = collision.offset_other;
-                Vector3 v_other = sum3(rb_other->velocity, cross(rb_other->angular_velocity, r_other));
-                v_rel = diff3(v_rel, v_other);
-            }
+            float bounce;
+            float friction;
+            combine_materials(rb, rb_other, &bounce, &friction);
 
-            // If both objects can move, move both halfway
-            if (rb && rb_other) {
-                delta_position = mult3(0.5f, delta_position);
-            }
+            // Resting contacts do not bounce, which would keep stacks from settling
+            float v_n = dot3(relative_velocity(rb, r, rb_other, r_other), n);
+            contact->target_velocity = v_n < -BOUNCE_THRESHOLD ? -bounce * v_n : 0.0f;
 
-            Vector3 v_n = proj3(v_rel, n);
-            Vector3 v_t = diff3(v_rel, v_n);
-            Vector3 t = normalized3(v_t);
+            // The normal may have turned since last tick, only keep friction in the contact plane
+            float side = entity < collision.entity ? 1.0f : -1.0f;
+            Vector3 friction_impulse = mult3(side, contact->friction_impulse);
+            friction_impulse = diff3(friction_impulse, mult3(dot3(friction_impulse, n), n));
+            contact->friction_impulse = mult3(side, friction_impulse);
 
-            if (dot3(v_rel, n) >= 0.0f) {
-                // Rigid bodies are separating
-                continue;
-            }
+            // Sleeping bodies keep their impulses until they wake up
+            if (rb->asleep && (!rb_other || rb_other->asleep)) continue;
 
-            // Take the minimum bounce factor, and maximum friction factor.
-            // Static objects have bounce 1 and friction 0.
-            float bounce = 1.0f;
-            float friction = 0.0f;
-            if (rb) {
-                bounce = rb->bounce;
-                friction = rb->friction;
-            }
+            Vector3 impulse = sum3(mult3(contact->normal_impulse, n), friction_impulse);
+            apply_impulse(entity, sum3(trans->position, r), impulse);
             if (rb_other) {
-                bounce = fminf(bounce, rb_other->bounce);
-                friction = fmaxf(friction, rb_other->friction);
+                TransformComponent* trans_other = get_component(collision.entity, COMPONENT_TRANSFORM);
+                apply_impulse(collision.entity, sum3(trans_other->position, r_other), neg3(impulse));
             }
+        }
+    }
+}
 
-            // Normal impulse
-            float j_n = -(1.0f + bounce) * dot3(v_rel, n);
-            float denom_n = 0.0f;
-            if (rb) {
-                denom_n = rb->inv_mass + dot3(n, cross(matrix3_map(rb->inv_inertia, cross(r, n)), r));
-            }
-            if (rb_other) {
-                denom_n += rb_other->inv_mass + dot3(n, cross(matrix3_map(rb_other->inv_inertia, cross(r_other, n)), r_other));
-            }
-            j_n /= denom_n;
 
-            // Tangential impulse
-            float j_t = -dot3(v_t, t);
-            float denom_t = 0.0f;
-            if (rb) {
-                denom_t = rb->inv_mass + dot3(t, cross(matrix3_map(rb->inv_inertia, cross(r, t)), r));
-            }
-            if (rb_other) {
-                denom_t += (rb_other->inv_mass + dot3(t, cross(matrix3_map(rb_other->inv_inertia, cross(r_other, t)), r_other)));
-            }
-            j_t /= denom_t;
+bool resolve_collisions(Entity entity, float bias) {
+    // Collisions are solved sequentially, updating positions and velocities of both bodies before moving
+    // to the next collision. Impulses are accumulated per contact and clamped as totals, so a later
+    // iteration can take back part of what an earlier one applied.
 
-            // Clamp according to Coulomb's law of friction
-            float j_t_max = friction * fabsf(j_n);
-            if (fabsf(j_t) > j_t_max) {
-                j_t = j_t_max * sign(j_t);
-            }
+    TransformComponent* trans = get_component(entity, COMPONENT_TRANSFORM);
+    RigidBodyComponent* rb = get_component(entity, COMPONENT_RIGIDBODY);
+    ColliderComponent* collider = get_component(entity, COMPONENT_COLLIDER);
 
-            if (fabsf(j_n) < 0.01f && fabsf(j_t) < 0.01f) {
-                // If impulse is negligible, skip the collision resolution
-                continue;
-            }
+    bool has_moved = false;
+    if (collider) {
+        for (int e = 0; e < collider->events_size; e++) {
+            ContactEvent* event = get_contact_event(collider, e);
+            if (event->type == CONTACT_END) continue;
+
+            int points = ContactCache_get(scene->contacts, event->manifold)->size;
+            for (int i = 0; i < points; i++) {
+                Collision collision = get_collision(event, entity, i);
+
+                RigidBodyComponent* rb_other = get_component(collision.entity, COMPONENT_RIGIDBODY);
+
+                // Only bodies are iterated, so collisions between two bodies are resolved once from the lower entity
+                if (rb_other && collision.entity > entity) continue;
+
+                Contact* contact = ContactCache_contact(scene->contacts, collision.contact);
+
+                Vector3 delta_position = mult3(bias, collision.overlap);
+                if (rb) {
+                    if (rb->axis_lock.x) {
+                        delta_position.x = 0.0f;
+                    } else if (rb->axis_lock.y) {
+                        delta_position.y = 0.0f;
+                    } else if (rb->axis_lock.z) {
+                        delta_position.z = 0.0f;
+                    }
+                }
 
-            // Total impulse
-            Vector3 j_total = sum3(mult3(j_n, n), mult3(j_t, t));
+                Vector3 n = normalized3(collision.overlap);
+                Vector3 r = collision.offset;
+                Vector3 r_other = rb_other ? collision.offset_other : zeros3();
+                Vector3 v_rel = relative_velocity(rb, r, rb_other, r_other);
 
-            float verticality = dot3(n, vec3(0.0f, 1.0f, 0.0f));
+                // If both objects can move, move both halfway
+                if (rb && rb_other) {
+                    delta_position = mult3(0.5f, delta_position);
+                }
 
-            if (rb) {
-                // TODO: What if entity has parent?
-                trans->position = sum3(trans->position, delta_position);
-                apply_impulse(entity, sum3(trans->position, r), j_total);
-                if (verticality > 0.99f) {
-                    rb->on_ground = true;
+                float bounce;
+                float friction;
+                combine_materials(rb, rb_other, &bounce, &friction);
+
+                // Normal impulse, the total may only push the bodies apart
+                float j_n = (contact->target_velocity - dot3(v_rel, n)) / effective_mass(rb, r, rb_other, r_other, n);
+                float normal_impulse = fmaxf(contact->normal_impulse + j_n, 0.0f);
+                j_n = normal_impulse - contact->normal_impulse;
+
+                // Tangential impulse, the total is clamped according to Coulomb's law of friction
+                Vector3 v_t = diff3(v_rel, mult3(dot3(v_rel, n), n));
+                Vector3 t = normalized3(v_t);
+                float side = entity < collision.entity ? 1.0f : -1.0f;
+                Vector3 friction_impulse = mult3(side, contact->friction_impulse);
+                Vector3 total_friction = diff3(friction_impulse, mult3(norm3(v_t) / effective_mass(rb, r, rb_other, r_other, t), t));
+                total_friction = clamp_magnitude3(total_friction, 0.0f, friction * normal_impulse);
+                Vector3 j_t = diff3(total_friction, friction_impulse);
+
+                // Negligible impulses are not applied so that resting bodies can fall asleep, but the
+                // overlap is still corrected
+                bool negligible = fabsf(j_n) < 1e-5f && norm3(j_t) < 1e-5f;
+                if (!negligible) {
+                    contact->normal_impulse = normal_impulse;
+                    contact->friction_impulse = mult3(side, total_friction);
+                } else if (norm3(collision.overlap) < POSITION_TOLERANCE) {
+                    continue;
                 }
-                has_moved = true;
-            }
 
-            if (rb_other) {
-                TransformComponent* trans_other = get_component(collision.entity, COMPONENT_TRANSFORM);
-                trans_other->position = sum3(trans_other->position, mult3(-1.0f, delta_position));
-                apply_impulse(collision.entity, sum3(trans_other->position, r_other), mult3(-1.0f, j_total));
-                if (verticality < -0.99f) {
-                    rb_other->on_ground = true;
+                // Total impulse
+                Vector3 j_total = negligible ? zeros3() : sum3(mult3(j_n, n), j_t);
+
+                float verticality = dot3(n, vec3(0.0f, 1.0f, 0.0f));
+
+                if (rb) {
+                    // TODO: What if entity has parent?
+                    set_position(entity, sum3(trans->position, delta_position));
+                    if (!negligible) {
+                        apply_impulse(entity, sum3(trans->position, r), j_total);
+                    }
+                    if (verticality > 0.99f) {
+                        rb->on_ground = true;
+                    }
+                    has_moved = true;
+                }
+
+                if (rb_other) {
+                    TransformComponent* trans_other = get_component(collision.entity, COMPONENT_TRANSFORM);
+                    set_position(collision.entity, sum3(trans_other->position, mult3(-1.0f, delta_position)));
+                    if (!negligible) {
+                        apply_impulse(collision.entity, sum3(trans_other->position, r_other), mult3(-1.0f, j_total));
+                    }
+                    if (verticality < -0.99f) {
+                        rb_other->on_ground = true;
+                    }
+                    has_moved = true;
                 }
-                has_moved = true;
             }
         }
     }
@@ -222,38 +295,122 @@ bool resolve_collisions(Entity entity, float bias) {
 
 
 void init_physics(void) {
-    for (Entity i = 0; i < scene->components->entities; i++) {
+    // Create the queries up front so that they are never registered while systems run concurrently
+    query_entities(COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_RIGIDBODY));
+    query_entities(
+        COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_RIGIDBODY) | COMPONENT_MASK(COMPONENT_COLLIDER)
+    );
+    query_entities(COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_COLLIDER));
+}
+
+
+static void update_inertia(ComponentArray* entities) {
+    for (int k = 0; k < entities->size; k++) {
+        Entity i = entities->entities[k];
+        if (!has_components(i, COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_RIGIDBODY) | COMPONENT_MASK(COMPONENT_COLLIDER))) {
+            continue;
+        }
         RigidBodyComponent* rigid_body = get_component(i, COMPONENT_RIGIDBODY);
-        if (rigid_body) {
-            // TODO: update inverse inertia
-            rigid_body->inv_inertia = matrix3_inverse(inertia_tensor(i));
+        rigid_body->inv_inertia = matrix3_inverse(inertia_tensor(i));
+    }
+}
+
+
+static Vector3 clamp_to_impact(Entity entity, RigidBodyComponent* rigid_body, Vector3 delta_position) {
+    // Sweeps the collider over the step and stops it where it first touches a static collider. The
+    // velocity bounces off the surface there, and the next collision update resolves the contact.
+    ColliderComponent* collider = get_component(entity, COMPONENT_COLLIDER);
+    if (!collider) {
+        return delta_position;
+    }
+
+    Shape shape = get_shape(entity);
+    Hit hit = {
+        .entity = NULL_ENTITY,
+        .distance = INFINITY
+    };
+    float radius = 0.0f;
+    switch (collider->type) {
+        case COLLIDER_SPHERE:
+            hit = sweep_sphere(shape.sphere, delta_position, entity);
+            radius = shape.sphere.radius;
+            break;
+        case COLLIDER_CAPSULE: {
+            // The ends and the middle of the capsule are swept as spheres
+            Vector3 up = matrix3_column(quaternion_to_rotation_matrix(shape.capsule.rotation), 1);
+            for (int k = -1; k <= 1; k++) {
+                Sphere sphere = {
+                    .center = sum3(shape.capsule.center, mult3(0.5f * k * shape.capsule.height, up)),
+                    .radius = shape.capsule.radius
+                };
+                Hit sphere_hit = sweep_sphere(sphere, delta_position, entity);
+                if (sphere_hit.distance < hit.distance) {
+                    hit = sphere_hit;
+                }
+            }
+            radius = shape.capsule.radius;
+            break;
+        }
+        default:
+            // Other shapes are not swept
+            rigid_body->fast = false;
+            return delta_position;
+    }
+
+    if (hit.entity == NULL_ENTITY) {
+        // A step shorter than the radius cannot pass through anything, so the body stops being swept
+        if (norm3(delta_position) < radius) {
+            rigid_body->fast = false;
         }
+        return delta_position;
+    }
+
+    float normal_velocity = dot3(rigid_body->velocity, hit.normal);
+    if (normal_velocity < 0.0f) {
+        float bounce = normal_velocity < -BOUNCE_THRESHOLD ? rigid_body->bounce : 0.0f;
+        rigid_body->velocity = diff3(rigid_body->velocity, mult3((1.0f + bounce) * normal_velocity, hit.normal));
     }
+    return mult3(hit.distance, delta_position);
 }
 
 
 void update_physics(float time_step) {
-    for (Entity i = 0; i < scene->components->entities; i++) {
-        RigidBodyComponent* rb = get_component(i, COMPONENT_RIGIDBODY);
-        if (rb) {
-            rb->on_ground = false;
-        }
+    ComponentArray* rigid_bodies = scene->components->rigid_body;
+    ComponentArray* bodies = query_entities(COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_RIGIDBODY));
+    ComponentArray* colliding_bodies = query_entities(
+        COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_RIGIDBODY) | COMPONENT_MASK(COMPONENT_COLLIDER)
+    );
+
+    // Inertia only changes with mass or collider shape
+    update_inertia(get_changes(COMPONENT_RIGIDBODY)->added);
+    update_inertia(get_changes(COMPONENT_RIGIDBODY)->modified);
+    update_inertia(get_changes(COMPONENT_COLLIDER)->added);
+    update_inertia(get_changes(COMPONENT_COLLIDER)->modified);
+
+    for (int k = 0; k < rigid_bodies->size; k++) {
+        RigidBodyComponent* rb = (RigidBodyComponent*)rigid_bodies->data + k;
+        rb->on_ground = false;
     }
 
-    for (Entity i = 0; i < scene->components->entities; i++) {
-        ColliderComponent* collider = get_component(i, COMPONENT_COLLIDER);
-        if (!collider) continue;
+    for (int k = 0; k < colliding_bodies->size; k++) {
+        warm_start(colliding_bodies->entities[k]);
+    }
 
-        for (int j = 0; j < ITERATIONS; j++) {
-            if (!resolve_collisions(i, 1.0f / (float)ITERATIONS)) {
-                break;
-            }
+    // Every iteration visits all bodies, so that impulses travel through stacks within a tick
+    for (int j = 0; j < ITERATIONS; j++) {
+        bool has_moved = false;
+        for (int k = 0; k < colliding_bodies->size; k++) {
+            Entity i = colliding_bodies->entities[k];
+            has_moved |= resolve_collisions(i, 1.0f / (float)ITERATIONS);
+        }
+        if (!has_moved) {
+            break;
         }
     }
 
-    for (Entity i = 0; i < scene->components->entities; i++) {
-        RigidBodyComponent* rigid_body = scene->components->rigid_body[i];
-        if (!rigid_body) continue;
+    for (int k = 0; k < bodies->size; k++) {
+        Entity i = bodies->entities[k];
+        RigidBodyComponent* rigid_body = get_component(i, COMPONENT_RIGIDBODY);
         if (rigid_body->asleep) continue;
 
         TransformComponent* trans = get_component(i, COMPONENT_TRANSFORM);
@@ -268,7 +425,10 @@ void update_physics(float time_step) {
         } else if (rigid_body->axis_lock.z) {
             delta_position.z = 0.0f;
         }
-        trans->position = sum3(trans->position, delta_position);
+        if (rigid_body->fast) {
+            delta_position = clamp_to_impact(i, rigid_body, delta_position);
+        }
+        set_position(i, sum3(trans->position, delta_position));
 
         rigid_body->angular_velocity = sum3(rigid_body->angular_velocity, mult3(time_step, rigid_body->angular_acceleration));
 
@@ -278,7 +438,7 @@ void update_physics(float time_step) {
         if (rigid_body->axis_lock.rotation) {
             delta_rotation = extract_twist(delta_rotation, rigid_body->axis_lock.rotation_axis);
         }
-        trans->rotation = quaternion_mult(delta_rotation, trans->rotation);
+        set_rotation(i, quaternion_mult(delta_rotation, trans->rotation));
 
         // Clamp velocities
         rigid_body->velocity = clamp_magnitude3(rigid_body->velocity, 0.0f, rigid_body->max_speed);
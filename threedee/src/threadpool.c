@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "threadpool.h"
+#include "util.h"
+
+
+ThreadPool* thread_pool = NULL;
+
+
+typedef struct {
+    RangeFunction function;
+    void* data;
+    int start;
+    int end;
+} RangeJob;
+
+
+static void finish_job(ThreadPool* pool, Job job) {
+    // Called with the mutex held
+    (*job.pending)--;
+    if (*job.pending == 0) {
+        SDL_BroadcastCondition(pool->job_done);
+    }
+}
+
+
+static Job pop_job(ThreadPool* pool) {
+    Job job = pool->jobs[pool->jobs_head];
+    pool->jobs_head = (pool->jobs_head + 1) % pool->jobs_capacity;
+    pool->jobs_size--;
+    return job;
+}
+
+
+static int worker(void* data) {
+    ThreadPool* pool = data;
+
+    SDL_LockMutex(pool->mutex);
+    while (true) {
+        while (!pool->quit && pool->jobs_size == 0) {
+            SDL_WaitCondition(pool->job_available, pool->mutex);
+        }
+        if (pool->quit) {
+            break;
+        }
+
+        Job job = pop_job(pool);
+        SDL_UnlockMutex(pool->mutex);
+        job.function(job.data);
+        SDL_LockMutex(pool->mutex);
+        finish_job(pool, job);
+    }
+    SDL_UnlockMutex(pool->mutex);
+
+    return 0;
+}
+
+
+ThreadPool* ThreadPool_create(int threads) {
+    ThreadPool* pool = malloc(sizeof(ThreadPool));
+    pool->jobs_capacity = 64;
+    pool->jobs = malloc(sizeof(Job) * pool->jobs_capacity);
+    pool->jobs_head = 0;
+    pool->jobs_size = 0;
+    pool->quit = false;
+    pool->mutex = SDL_CreateMutex();
+    pool->job_available = SDL_CreateCondition();
+    pool->job_done = SDL_CreateCondition();
+
+    pool->threads = malloc(sizeof(SDL_Thread*) * (threads > 0 ? threads : 1));
+    pool->threads_size = 0;
+    for (int i = 0; i < threads; i++) {
+        SDL_Thread* thread = SDL_CreateThread(worker, "worker", pool);
+        if (!thread) {
+            LOG_ERROR("Failed to create worker thread: %s", SDL_GetError());
+            break;
+        }
+        pool->threads[pool->threads_size] = thread;
+        pool->threads_size++;
+    }
+
+    LOG_INFO("Thread pool created with %d workers", pool->threads_size);
+
+    return pool;
+}
+
+
+void ThreadPool_submit(ThreadPool* pool, JobFunction function, void* data, int* pending) {
+    if (pool->threads_size == 0) {
+        function(data);
+        return;
+    }
+
+    SDL_LockMutex(pool->mutex);
+    if (pool->jobs_size == pool->jobs_capacity) {
+        // Unroll the ring into a buffer twice the size
+        Job* jobs = malloc(sizeof(Job) * 2 * pool->jobs_capacity);
+        for (int i = 0; i < pool->jobs_size; i++) {
+            jobs[i] = pool->jobs[(pool->jobs_head + i) % pool->jobs_capacity];
+        }
+        free(pool->jobs);
+        pool->jobs = jobs;
+        pool->jobs_head = 0;
+        pool->jobs_capacity *= 2;
+    }
+
+    int tail = (pool->jobs_head + pool->jobs_size) % pool->jobs_capacity;
+    pool->jobs[tail] = (Job) { .function = function, .data = data, .pending = pending };
+    pool->jobs_size++;
+    (*pending)++;
+
+    SDL_SignalCondition(pool->job_available);
+    SDL_UnlockMutex(pool->mutex);
+}
+
+
+void ThreadPool_wait(ThreadPool* pool, int* pending) {
+    if (pool->threads_size == 0) {
+        return;
+    }
+
+    SDL_LockMutex(pool->mutex);
+    while (*pending > 0) {
+        if (pool->jobs_size > 0) {
+            // Help out instead of idling, possibly with jobs from other batches
+            Job job = pop_job(pool);
+            SDL_UnlockMutex(pool->mutex);
+            job.function(job.data);
+            SDL_LockMutex(pool->mutex);
+            finish_job(pool, job);
+        } else {
+            SDL_WaitCondition(pool->job_done, pool->mutex);
+        }
+    }
+    SDL_UnlockMutex(pool->mutex);
+}
+
+
+static void run_range(void* data) {
+    RangeJob* range = data;
+    range->function(range->data, range->start, range->end);
+}
+
+
+void ThreadPool_parallel_for(ThreadPool* pool, int start, int end, int min_batch, RangeFunction function, void* data) {
+    int count = end - start;
+    if (!pool || pool->threads_size == 0 || count <= min_batch) {
+        function(data, start, end);
+        return;
+    }
+
+    // One range per thread including the caller, but never smaller than min_batch
+    int ranges = mini(pool->threads_size + 1, MAX_PARALLEL_RANGES);
+    ranges = mini(ranges, (count + min_batch - 1) / min_batch);
+    int batch = (count + ranges - 1) / ranges;
+
+    RangeJob jobs[MAX_PARALLEL_RANGES];
+    int pending = 0;
+    for (int i = 0; i < ranges; i++) {
+        jobs[i] = (RangeJob) {
+            .function = function,
+            .data = data,
+            .start = start + i * batch,
+            .end = mini(start + (i + 1) * batch, end)
+        };
+    }
+    for (int i = 1; i < ranges; i++) {
+        ThreadPool_submit(pool, run_range, &jobs[i], &pending);
+    }
+    run_range(&jobs[0]);
+    ThreadPool_wait(pool, &pending);
+}
+
+
+void ThreadPool_destroy(ThreadPool* pool) {
+    SDL_LockMutex(pool->mutex);
+    pool->quit = true;
+    SDL_BroadcastCondition(pool->job_available);
+    SDL_UnlockMutex(pool->mutex);
+
+    for (int i = 0; i < pool->threads_size; i++) {
+        SDL_WaitThread(pool->threads[i], NULL);
+    }
+
+    SDL_DestroyCondition(pool->job_available);
+    SDL_DestroyCondition(pool->job_done);
+    SDL_DestroyMutex(pool->mutex);
+    free(pool->threads);
+    free(pool->jobs);
+    free(pool);
+}
@@ -8,6 +8,7 @@
 #endif
 
 #include "app.h"
+#include "component.h"
 #include "settings.h"
 #include "util.h"
 
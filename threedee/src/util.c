@@ -357,3 +357,31 @@ void get_rect_corners(Vector2 position, float angle, float width, float height,
 float map_to_range(int x, int min_x, int max_x, float min_y, float max_y) {
     return min_y + (max_y - min_y) * (x - min_x) / (max_x - min_x);
 }
+
+
+float ray_triangle_distance(Triangle triangle, Vector3 origin, Vector3 direction) {
+    // Möller-Trumbore, both sides of the triangle count
+    Vector3 ab = diff3(triangle.b, triangle.a);
+    Vector3 ac = diff3(triangle.c, triangle.a);
+    Vector3 p = cross(direction, ac);
+    float det = dot3(ab, p);
+    if (fabsf(det) < 1e-12f) {
+        return INFINITY;
+    }
+
+    float inv_det = 1.0f / det;
+    Vector3 ao = diff3(origin, triangle.a);
+    float u = dot3(ao, p) * inv_det;
+    if (u < 0.0f || u > 1.0f) {
+        return INFINITY;
+    }
+
+    Vector3 q = cross(ao, ab);
+    float v = dot3(direction, q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f) {
+        return INFINITY;
+    }
+
+    float t = dot3(ac, q) * inv_det;
+    return t >= 0.0f ? t : INFINITY;
+}
@@ -0,0 +1,129 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "component.h"
+#include "narrowphase.h"
+#include "scene.h"
+#include "threadpool.h"
+#include "util.h"
+
+// Shapes are placed in a small volume so that a good share of the pairs overlap
+#define TEST_SHAPES 90
+#define TEST_SEEDS 4
+#define TEST_TOLERANCE 1e-4f
+
+
+static Entity create_shape(int type) {
+    Entity i = create_entity();
+    TransformComponent* trans = TransformComponent_add(i, vec3(randf(-3.0f, 3.0f), randf(-3.0f, 3.0f),
+        randf(-3.0f, 3.0f)));
+    trans->rotation = quaternion_normalize((Quaternion) { randf(-1.0f, 1.0f), randf(-1.0f, 1.0f),
+        randf(-1.0f, 1.0f), randf(-1.0f, 1.0f) });
+
+    if (type == 0) {
+        ColliderComponent_add(i, (ColliderParameters) { .type = COLLIDER_SPHERE, .group = GROUP_PROPS,
+            .radius = randf(0.2f, 1.5f) });
+    } else if (type == 1) {
+        ColliderComponent_add(i, (ColliderParameters) { .type = COLLIDER_AABB, .group = GROUP_PROPS,
+            .width = randf(0.2f, 2.0f), .height = randf(0.2f, 2.0f), .depth = randf(0.2f, 2.0f) });
+    } else {
+        ColliderComponent_add(i, (ColliderParameters) { .type = COLLIDER_CAPSULE, .group = GROUP_PROPS,
+            .radius = randf(0.2f, 1.0f), .height = randf(0.5f, 2.0f) });
+    }
+
+    return i;
+}
+
+
+static bool close_enough(Vector3 a, Vector3 b) {
+    return fabsf(a.x - b.x) < TEST_TOLERANCE && fabsf(a.y - b.y) < TEST_TOLERANCE && fabsf(a.z - b.z) < TEST_TOLERANCE;
+}
+
+
+static int test_seed(unsigned int seed) {
+    // Every ordered pair goes through the narrowphase, so both orders of each batched pair are covered
+    srand(seed);
+    Entity entities[TEST_SHAPES];
+    for (int k = 0; k < TEST_SHAPES; k++) {
+        entities[k] = create_shape(k % 3);
+    }
+    update_transforms();
+    update_collider_shapes(query_entities(COMPONENT_MASK(COMPONENT_TRANSFORM) | COMPONENT_MASK(COMPONENT_COLLIDER)));
+
+    Narrowphase* narrowphase = Narrowphase_create();
+    Narrowphase_reset(narrowphase, TEST_SHAPES * TEST_SHAPES);
+    for (int a = 0; a < TEST_SHAPES; a++) {
+        for (int b = 0; b < TEST_SHAPES; b++) {
+            if (a == b) continue;
+            Narrowphase_add(narrowphase, a * TEST_SHAPES + b, entities[a], entities[b], NULL);
+        }
+    }
+    Narrowphase_run(narrowphase);
+
+    int failures = 0;
+    int overlapping = 0;
+    for (int a = 0; a < TEST_SHAPES; a++) {
+        for (int b = 0; b < TEST_SHAPES; b++) {
+            if (a == b) continue;
+            Penetration expected = get_penetration(entities[a], entities[b]);
+            Penetration result = narrowphase->penetrations[a * TEST_SHAPES + b];
+            if (expected.valid) overlapping++;
+
+            bool same = expected.valid == result.valid;
+            if (same && expected.valid) {
+                same = close_enough(expected.overlap, result.overlap)
+                    && close_enough(expected.contact_point, result.contact_point);
+            }
+            if (!same) {
+                if (failures < 5) {
+                    LOG_ERROR("Seed %u, pair %d %d: expected %d (%f, %f, %f), got %d (%f, %f, %f)", seed, a, b,
+                        expected.valid, expected.overlap.x, expected.overlap.y, expected.overlap.z,
+                        result.valid, result.overlap.x, result.overlap.y, result.overlap.z);
+                }
+                failures++;
+            }
+        }
+    }
+    LOG_INFO("Seed %u: %d pairs, %d overlapping, %d mismatched", seed, TEST_SHAPES * (TEST_SHAPES - 1), overlapping,
+        failures);
+
+    Narrowphase_destroy(narrowphase);
+    ComponentData_clear();
+
+    return failures;
+}
+
+
+int main(int argc, char* argv[]) {
+    UNUSED(argc);
+    UNUSED(argv);
+
+    #ifdef NARROWPHASE_SCALAR
+        LOG_INFO("Testing the scalar narrowphase against get_penetration");
+    #else
+        LOG_INFO("Testing the narrowphase against get_penetration");
+    #endif
+
+    scene = malloc(sizeof(Scene));
+    scene->components = ComponentData_create();
+    scene->commands = CommandBuffer_create();
+
+    // Once on the calling thread alone, then split across workers
+    int failures = 0;
+    int workers[] = { 0, 3 };
+    for (int w = 0; w < LENGTH(workers); w++) {
+        thread_pool = ThreadPool_create(workers[w]);
+        for (int s = 0; s < TEST_SEEDS; s++) {
+            failures += test_seed(1000 * w + s + 1);
+        }
+        ThreadPool_destroy(thread_pool);
+        thread_pool = NULL;
+    }
+
+    if (failures > 0) {
+        LOG_ERROR("%d narrowphase results differ from get_penetration", failures);
+        return 1;
+    }
+    return 0;
+}